@@ -1,190 +1,681 @@
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-#include <ctype.h>
-#include "LineParser.h"
-
-#ifndef NULL
-    #define NULL 0
-#endif
-
-#define FREE(X) if(X) free((void*)X)
-
-static char *cloneFirstWord(char *str)
-{
-    char *start = NULL;
-    char *end = NULL;
-    char *word;
-
-    while (!end) {
-        switch (*str) {
-            case '>':
-            case '<':
-            case 0:
-                end = str - 1;
-                break;
-            case ' ':
-                if (start)
-                    end = str - 1;
-                break;
-            default:
-                if (!start)
-                    start = str;
-                break;
-        }
-        str++;
-    }
-
-    if (start == NULL)
-        return NULL;
-
-    word = (char*) malloc(end-start+2);
-    strncpy(word, start, ((int)(end-start)+1)) ;
-    word[ (int)((end-start)+1)] = 0;
-
-    return word;
-}
-
-static void extractRedirections(char *strLine, cmdLine *pCmdLine)
-{
-    char *s = strLine;
-
-    while ( (s = strpbrk(s,"<>")) ) {
-        if (*s == '<') {
-            FREE(pCmdLine->inputRedirect);
-            pCmdLine->inputRedirect = cloneFirstWord(s+1);
-        }
-        else {
-            FREE(pCmdLine->outputRedirect);
-            pCmdLine->outputRedirect = cloneFirstWord(s+1);
-        }
-
-        *s++ = 0;
-    }
-}
-
-static char *strClone(const char *source)
-{
-    char* clone = (char*)malloc(strlen(source) + 1);
-    strcpy(clone, source);
-    return clone;
-}
-
-static int isEmpty(const char *str)
-{
-  if (!str)
-    return 1;
-  
-  while (*str)
-    if (!isspace(*(str++)))
-      return 0;
-    
-  return 1;
-}
-
-static cmdLine *parseSingleCmdLine(const char *strLine)
-{
-    char *delimiter = " ";
-    char *line, *result;
-    
-    if (isEmpty(strLine))
-      return NULL;
-    
-    cmdLine* pCmdLine = (cmdLine*)malloc( sizeof(cmdLine) ) ;
-    memset(pCmdLine, 0, sizeof(cmdLine));
-    
-    line = strClone(strLine);
-         
-    extractRedirections(line, pCmdLine);
-    
-    result = strtok( line, delimiter);    
-    while( result && pCmdLine->argCount < MAX_ARGUMENTS-1) {
-        ((char**)pCmdLine->arguments)[pCmdLine->argCount++] = strClone(result);
-        result = strtok ( NULL, delimiter);
-    }
-
-    FREE(line);
-    return pCmdLine;
-}
-
-static cmdLine* _parseCmdLines(char *line)
-{
-	char *nextStrCmd;
-	cmdLine *pCmdLine;
-	char pipeDelimiter = '|';
-	
-	if (isEmpty(line))
-	  return NULL;
-	
-	nextStrCmd = strchr(line , pipeDelimiter);
-	if (nextStrCmd)
-	  *nextStrCmd = 0;
-	
-	pCmdLine = parseSingleCmdLine(line);
-	if (!pCmdLine)
-	  return NULL;
-	
-	if (nextStrCmd)
-	  pCmdLine->next = _parseCmdLines(nextStrCmd+1);
-
-	return pCmdLine;
-}
-
-cmdLine *parseCmdLines(const char *strLine)
-{
-	char* line, *ampersand;
-	cmdLine *head, *last;
-	int idx = 0;
-	
-	if (isEmpty(strLine))
-	  return NULL;
-	
-	line = strClone(strLine);
-	if (line[strlen(line)-1] == '\n')
-	  line[strlen(line)-1] = 0;
-	
-	ampersand = strchr( line,  '&');
-	if (ampersand)
-	  *(ampersand) = 0;
-		
-	if ( (last = head = _parseCmdLines(line)) )
-	{	
-	  while (last->next)
-	    last = last->next;
-	  last->blocking = ampersand? 0:1;
-	}
-	
-	for (last = head; last; last = last->next)
-		last->idx = idx++;
-			
-	FREE(line);
-	return head;
-}
-
-
-void freeCmdLines(cmdLine *pCmdLine)
-{
-  int i;
-  if (!pCmdLine)
-    return;
-
-  FREE(pCmdLine->inputRedirect);
-  FREE(pCmdLine->outputRedirect);
-  for (i=0; i<pCmdLine->argCount; ++i)
-      FREE(pCmdLine->arguments[i]);
-
-  if (pCmdLine->next)
-	  freeCmdLines(pCmdLine->next);
-
-  FREE(pCmdLine);
-}
-
-int replaceCmdArg(cmdLine *pCmdLine, int num, const char *newString)
-{
-  if (num >= pCmdLine->argCount)
-    return 0;
-  
-  FREE(pCmdLine->arguments[num]);
-  ((char**)pCmdLine->arguments)[num] = strClone(newString);
-  return 1;
-}
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "LineParser.h"
+
+#if defined(__SSE2__) && !defined(LINEPARSER_SCALAR)
+#include <emmintrin.h>
+#endif
+
+#ifndef NULL
+    #define NULL 0
+#endif
+
+#define FREE(X) if(X) free((void*)X)
+#define ALIGN(N) (((N) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+#define LINE_PAD 16	/* slack after the line copy for the 16-byte word scan */
+
+/* Overflow chunk, only needed when the first estimate was too small */
+typedef struct arenaChunk
+{
+    struct arenaChunk *next;
+    char data[];
+} arenaChunk;
+
+/* One line's memory. The header sits at the start of the block, nodes and */
+/* argv arrays are bumped from the front, the line copy sits at the back */
+typedef struct lineArena
+{
+    char *cur;		/* next free byte of the current chunk */
+    char *end;		/* end of the current chunk's bump space */
+    size_t chunkSize;	/* size of the last chunk, doubled on overflow */
+    int live;		/* nodes not yet released by freeCmdLines */
+    arenaChunk *extra;	/* overflow chunks */
+    struct lineForm *form;	/* cached form the strings are shared with, NULL if own copy */
+    char data[];
+} lineArena;
+
+static void releaseForm(struct lineForm *f);
+
+static lineArena *arenaCreate(size_t bump, size_t lineLen)
+{
+    bump = ALIGN(bump);
+    lineArena *a = (lineArena*) malloc(sizeof(lineArena) + bump + lineLen + 1 + LINE_PAD);
+    if (!a)
+        return NULL;
+    a->cur = a->data;
+    a->end = a->data + bump;
+    a->chunkSize = bump;
+    a->live = 0;
+    a->extra = NULL;
+    a->form = NULL;
+    return a;
+}
+
+static void arenaFree(lineArena *a)
+{
+    arenaChunk *c = a->extra;
+    if (a->form)
+        releaseForm(a->form);
+    while (c) {
+        arenaChunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    free(a);
+}
+
+/* Starts a new chunk able to hold at least size bytes */
+static int arenaGrow(lineArena *a, size_t size)
+{
+    size_t chunk = a->chunkSize * 2;
+    while (chunk < size)
+        chunk *= 2;
+    arenaChunk *c = (arenaChunk*) malloc(sizeof(arenaChunk) + chunk);
+    if (!c)
+        return 0;
+    c->next = a->extra;
+    a->extra = c;
+    a->cur = c->data;
+    a->end = c->data + chunk;
+    a->chunkSize = chunk;
+    return 1;
+}
+
+static void *arenaAlloc(lineArena *a, size_t size)
+{
+    void *p;
+    size = ALIGN(size);
+    if ((size_t)(a->end - a->cur) < size && !arenaGrow(a, size))
+        return NULL;
+    p = a->cur;
+    a->cur += size;
+    return p;
+}
+
+static int isBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+/* First byte at or after s that ends a word (blank, |, &, <, > or NUL) */
+/* or may start a $(...) substitution, which cutWord() steps over */
+#if defined(__SSE2__) && !defined(LINEPARSER_SCALAR)
+/* 16 bytes at a time. Loads are aligned; the one holding the terminating */
+/* NUL may run past it into the LINE_PAD slack of the arena */
+static unsigned wordEndMask(__m128i v)
+{
+    __m128i m = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('$')));
+    /* '<' and '>' differ only in bit 1 */
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_or_si128(v, _mm_set1_epi8(2)), _mm_set1_epi8('>')));
+    return (unsigned) _mm_movemask_epi8(m);
+}
+
+static char *wordEnd(char *s)
+{
+    uintptr_t skew = (uintptr_t)s & 15;
+    const __m128i *block = (const __m128i*)(s - skew);
+    unsigned mask = wordEndMask(_mm_load_si128(block)) >> skew;
+    if (mask)
+        return s + __builtin_ctz(mask);
+    for (;;) {
+        mask = wordEndMask(_mm_load_si128(++block));
+        if (mask)
+            return (char*)block + __builtin_ctz(mask);
+    }
+}
+#else
+static char *wordEnd(char *s)
+{
+    char c;
+    while ((c = *s) && !isBlank(c) && c != '|' && c != '&' && c != '<' && c != '>' && c != '$')
+        s++;
+    return s;
+}
+#endif
+
+const char *substitutionEnd(const char *s)
+{
+    int depth = 1;
+    for (; *s; s++) {
+        if (*s == '(')
+            depth++;
+        else if (*s == ')' && --depth == 0)
+            break;
+    }
+    return s;
+}
+
+/* Terminates the word starting at *pp in place and moves *pp past it */
+/* A $(...) inside the word is part of it, blanks and operators included */
+/* Returns the character the terminator replaced */
+static char cutWord(char **pp)
+{
+    char *s = *pp;
+    while (*(s = wordEnd(s)) == '$') {
+        if (s[1] != '(')
+            s++;
+        else if (*(s = (char*) substitutionEnd(s + 2)))
+            s++;    /* past the ')' */
+    }
+    char c = *s;
+    *s = 0;
+    *pp = s;
+    return c;
+}
+
+/* Appends one argv slot for the stage being built. Slots stay contiguous: */
+/* if the chunk runs out, the slots gathered so far move to the new chunk */
+static char **pushArg(lineArena *a, char **argv, int argc, char *arg)
+{
+    if (a->cur + sizeof(char*) > a->end) {
+        char **moved;
+        if (!arenaGrow(a, (argc + 1) * sizeof(char*)))
+            return NULL;
+        moved = (char**) a->cur;
+        memcpy(moved, argv, argc * sizeof(char*));
+        a->cur += argc * sizeof(char*);
+        argv = moved;
+    }
+    argv[argc] = arg;
+    a->cur += sizeof(char*);
+    return argv;
+}
+
+/* Tokenizes one stage starting at *pp, leaving *pp on the '|' or end of line */
+/* Returns NULL for a stage without a command */
+static cmdLine *parseSingleCmdLine(lineArena *a, char **pp, char *delim)
+{
+    cmdLine *pCmdLine = (cmdLine*) arenaAlloc(a, sizeof(cmdLine));
+    char **argv;
+    char *p = *pp;
+    char c = *p;
+    int argc = 0;
+
+    if (!pCmdLine)
+        return NULL;
+    memset(pCmdLine, 0, sizeof(cmdLine));
+    pCmdLine->arena = a;
+    argv = (char**) a->cur;
+
+    while (argv) {
+        while (isBlank(c))
+            c = *++p;
+        if (!c || c == '|' || c == '&')
+            break;
+
+        if (c == '<' && p[1] == '<') {
+            /* <<<word here-string, <<WORD or <<'WORD' here-document */
+            int string = p[2] == '<';
+            char *word;
+            p += string ? 3 : 2;
+            c = *p;
+            while (isBlank(c))
+                c = *++p;
+            word = p;
+            c = cutWord(&p);
+            if (!string && (*word == '\'' || *word == '"') && p - word > 1 && p[-1] == *word) {
+                p[-1] = 0;
+                word++;
+            }
+            pCmdLine->hereText = string && *word ? word : NULL;
+            pCmdLine->hereDelim = !string && *word ? word : NULL;
+            pCmdLine->inputRedirect = NULL;
+            continue;
+        }
+
+        if (c == '<' || c == '>') {
+            char redirect = c;
+            char *word;
+            c = *++p;
+            while (c == '>' || isBlank(c))
+                c = *++p;
+            word = p;
+            c = cutWord(&p);
+            if (redirect == '<') {
+                pCmdLine->inputRedirect = *word ? word : NULL;
+                pCmdLine->hereText = pCmdLine->hereDelim = NULL;
+            }
+            else
+                pCmdLine->outputRedirect = *word ? word : NULL;
+            continue;
+        }
+
+        argv = pushArg(a, argv, argc, p);
+        argc++;
+        c = cutWord(&p);
+    }
+
+    *pp = p;
+    *delim = c;
+    if (!argv)
+        return NULL;
+    if (!argc) {
+        a->cur = (char*) argv;	/* give back the unused slots */
+        return NULL;
+    }
+    if (!(argv = pushArg(a, argv, argc, NULL)))
+        return NULL;
+    pCmdLine->arguments = argv;
+    pCmdLine->argCount = argc;
+    return pCmdLine;
+}
+
+/* Parses strLine; *text gets the arena's copy of the line, which the */
+/* tokens point into */
+static cmdLine *parseLine(const char *strLine, const char **text)
+{
+	lineArena *a;
+	cmdLine *head = NULL, **link = &head, *last = NULL;
+	char *line, *p;
+	char delim;
+	size_t len;
+	int idx = 0;
+	
+	if (!strLine)
+	  return NULL;
+	
+	/* Room for a few stages and about one argument per four characters; */
+	/* longer argument lists spill into an overflow chunk */
+	len = strlen(strLine);
+	a = arenaCreate(2 * sizeof(cmdLine) + (len / 4 + 8) * sizeof(char*), len);
+	if (!a)
+	  return NULL;
+	line = a->data + a->chunkSize;
+	memcpy(line, strLine, len + 1);
+	*text = line;
+	if (len && line[len-1] == '\n')
+	  line[len-1] = 0;
+	
+	p = line;
+	do {
+	  cmdLine *pCmdLine = parseSingleCmdLine(a, &p, &delim);
+	  if (!pCmdLine)
+	    break;
+	  pCmdLine->idx = idx++;
+	  *link = last = pCmdLine;
+	  link = &pCmdLine->next;
+	  p++;
+	} while (delim == '|');
+	
+	if (!head) {
+	  arenaFree(a);
+	  return NULL;
+	}
+	
+	/* '&' anywhere ends the line and backgrounds it; the sweep stops at */
+	/* the first one unless an empty stage cut it short */
+	last->blocking = (delim == '&' || (delim && strchr(p + 1, '&'))) ? 0 : 1;
+	a->live = idx;
+	return head;
+}
+
+
+cmdLine *parseCmdLines(const char *strLine)
+{
+	const char *text;
+	return parseLine(strLine, &text);
+}
+
+
+void freeCmdLines(cmdLine *pCmdLine)
+{
+  lineArena *a;
+  if (!pCmdLine)
+    return;
+
+  a = pCmdLine->arena;
+  for (; pCmdLine; pCmdLine = pCmdLine->next)
+    a->live--;
+  if (a->live <= 0)
+    arenaFree(a);
+}
+
+int setHereDoc(cmdLine *pCmdLine, const char *body)
+{
+  char *clone = (char*) arenaAlloc(pCmdLine->arena, strlen(body) + 1);
+  if (!clone)
+    return 0;
+  strcpy(clone, body);
+  pCmdLine->hereText = clone;
+  return 1;
+}
+
+int spliceCmdArg(cmdLine *pCmdLine, int num, char *const *newArgs, int count)
+{
+  int argc = pCmdLine->argCount - 1 + count, i;
+  char **argv;
+  if (num >= pCmdLine->argCount)
+    return 0;
+
+  argv = (char**) arenaAlloc(pCmdLine->arena, (argc + 1) * sizeof(char*));
+  if (!argv)
+    return 0;
+  memcpy(argv, pCmdLine->arguments, num * sizeof(char*));
+  for (i = 0; i < count; i++) {
+    argv[num + i] = (char*) arenaAlloc(pCmdLine->arena, strlen(newArgs[i]) + 1);
+    if (!argv[num + i])
+      return 0;
+    strcpy(argv[num + i], newArgs[i]);
+  }
+  memcpy(argv + num + count, pCmdLine->arguments + num + 1,
+         (pCmdLine->argCount - num - 1) * sizeof(char*));
+  argv[argc] = NULL;
+  pCmdLine->arguments = argv;
+  pCmdLine->argCount = argc;
+  return 1;
+}
+
+int replaceCmdArg(cmdLine *pCmdLine, int num, const char *newString)
+{
+  char *clone;
+  if (num >= pCmdLine->argCount)
+    return 0;
+  
+  clone = (char*) arenaAlloc(pCmdLine->arena, strlen(newString) + 1);
+  if (!clone)
+    return 0;
+  strcpy(clone, newString);
+  ((char**)pCmdLine->arguments)[num] = clone;
+  return 1;
+}
+
+/* Parsed-line cache. A cached line is kept as a lineForm: one block with no */
+/* pointers in it, holding the tokenized copy of the line and, per stage, */
+/* offsets into it. A hit builds the nodes and argv arrays in a small arena */
+/* of its own and points them at the form's text, which stays shared and is */
+/* never written: setHereDoc, spliceCmdArg and replaceCmdArg copy what they */
+/* change into the line's arena. Live lines hold a reference, so evicting a */
+/* form only frees it once the last of them is released */
+#define LINE_CACHE_DEFAULT 64
+#define LINE_CACHE_MAX_LINE 4096	/* longer lines are parsed every time */
+#define LINE_CACHE_SEEN 4096	/* hashes of recently missed lines, a power of two */
+
+typedef struct
+{
+    int argc;
+    int firstArg;	/* index of the stage's first offset in args */
+    int inputRedirect;	/* offsets into the text, -1 for NULL */
+    int outputRedirect;
+    int hereDelim;
+    int hereText;
+} stageForm;
+
+typedef struct lineForm
+{
+    struct lineForm *chain;	/* hash bucket */
+    struct lineForm *newer, *older;	/* LRU order */
+    unsigned hash;
+    int refs;		/* the cache's and one per live line */
+    size_t size;	/* bytes of the whole block */
+    size_t len;		/* key length */
+    int stages;
+    int argTotal;
+    char blocking;
+    /* stageForm[stages], int args[argTotal], key[len + 1], text[len + 1] */
+    stageForm stage[];
+} lineForm;
+
+static struct
+{
+    lineForm **buckets;	/* allocated at first use */
+    int bucketCount;	/* a power of two, at least twice the capacity */
+    lineForm *newest, *oldest;
+    int count;
+    int capacity;	/* 0 turns the cache off */
+    size_t bytes;
+    long hits, misses, evictions;
+    unsigned seen[LINE_CACHE_SEEN];	/* a line is cached when it misses twice */
+} cache = { .capacity = LINE_CACHE_DEFAULT };
+
+static int *formArgs(lineForm *f)
+{
+    return (int*) (f->stage + f->stages);
+}
+
+static char *formKey(lineForm *f)
+{
+    return (char*) (formArgs(f) + f->argTotal);
+}
+
+static char *formText(lineForm *f)
+{
+    return formKey(f) + f->len + 1;
+}
+
+/* Eight bytes a step: a hit must cost well under the parse it saves, and */
+/* the tokenizer itself goes 16 bytes at a time */
+static unsigned lineHash(const char *s, size_t len)
+{
+    uint64_t h = len * 0x9e3779b97f4a7c15ull, w;
+    for (; len >= 8; s += 8, len -= 8) {
+        memcpy(&w, s, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    w = 0;
+    memcpy(&w, s, len);
+    /* murmur3's finalizer: the slots are taken from the low bits, which */
+    /* a product alone only feeds from the low bytes */
+    h ^= w;
+    h = (h ^ (h >> 33)) * 0xff51afd7ed558ccdull;
+    h = (h ^ (h >> 33)) * 0xc4ceb9fe1a85ec53ull;
+    return (unsigned) (h ^ (h >> 33));
+}
+
+static void releaseForm(lineForm *f)
+{
+    if (--f->refs == 0)
+        free(f);
+}
+
+static int textOffset(const char *s, const char *text)
+{
+    return s ? (int) (s - text) : -1;
+}
+
+/* The form of a freshly parsed line; text is its tokenized copy */
+static lineForm *makeForm(const cmdLine *head, const char *strLine, size_t len,
+                          const char *text, unsigned hash)
+{
+    const cmdLine *c;
+    lineForm *f;
+    int stages = 0, argTotal = 0, n = 0, i;
+    size_t size;
+
+    for (c = head; c; c = c->next) {
+        stages++;
+        argTotal += c->argCount;
+    }
+    size = sizeof(lineForm) + stages * sizeof(stageForm) + argTotal * sizeof(int) + 2 * (len + 1);
+    if (!(f = (lineForm*) malloc(size)))
+        return NULL;
+    f->hash = hash;
+    f->refs = 1;
+    f->size = size;
+    f->len = len;
+    f->stages = stages;
+    f->argTotal = argTotal;
+    for (c = head, i = 0; c; c = c->next, i++) {
+        stageForm *s = &f->stage[i];
+        int k;
+        s->argc = c->argCount;
+        s->firstArg = n;
+        for (k = 0; k < c->argCount; k++)
+            formArgs(f)[n++] = textOffset(c->arguments[k], text);
+        s->inputRedirect = textOffset(c->inputRedirect, text);
+        s->outputRedirect = textOffset(c->outputRedirect, text);
+        s->hereDelim = textOffset(c->hereDelim, text);
+        s->hereText = textOffset(c->hereText, text);
+        if (!c->next)
+            f->blocking = c->blocking;
+    }
+    memcpy(formKey(f), strLine, len + 1);
+    memcpy(formText(f), text, len + 1);
+    return f;
+}
+
+/* A line built from f: new nodes and argv arrays, shared strings */
+static cmdLine *cloneForm(lineForm *f)
+{
+    const char *text = formText(f);
+    cmdLine *head = NULL, **link = &head;
+    lineArena *a;
+    int i, k;
+
+    a = arenaCreate(f->stages * sizeof(cmdLine) + (f->argTotal + f->stages) * sizeof(char*), 0);
+    if (!a)
+        return NULL;
+    for (i = 0; i < f->stages; i++) {
+        const stageForm *s = &f->stage[i];
+        cmdLine *c = (cmdLine*) arenaAlloc(a, sizeof(cmdLine));
+        char **argv = (char**) arenaAlloc(a, (s->argc + 1) * sizeof(char*));
+        memset(c, 0, sizeof(cmdLine));
+        for (k = 0; k < s->argc; k++)
+            argv[k] = (char*) text + formArgs(f)[s->firstArg + k];
+        argv[s->argc] = NULL;
+        c->arguments = argv;
+        c->argCount = s->argc;
+        c->inputRedirect = s->inputRedirect < 0 ? NULL : text + s->inputRedirect;
+        c->outputRedirect = s->outputRedirect < 0 ? NULL : text + s->outputRedirect;
+        c->hereDelim = s->hereDelim < 0 ? NULL : text + s->hereDelim;
+        c->hereText = s->hereText < 0 ? NULL : text + s->hereText;
+        c->blocking = i == f->stages - 1 ? f->blocking : 0;
+        c->idx = i;
+        c->arena = a;
+        *link = c;
+        link = &c->next;
+    }
+    a->live = f->stages;
+    a->form = f;
+    f->refs++;
+    return head;
+}
+
+static void unlinkAge(lineForm *f)
+{
+    if (f->newer)
+        f->newer->older = f->older;
+    else
+        cache.newest = f->older;
+    if (f->older)
+        f->older->newer = f->newer;
+    else
+        cache.oldest = f->newer;
+}
+
+static void pushNewest(lineForm *f)
+{
+    f->older = cache.newest;
+    f->newer = NULL;
+    if (cache.newest)
+        cache.newest->newer = f;
+    else
+        cache.oldest = f;
+    cache.newest = f;
+}
+
+/* Drops the cache's reference to the oldest form */
+static void evictOldest(void)
+{
+    lineForm *f = cache.oldest;
+    lineForm **b = &cache.buckets[f->hash & (cache.bucketCount - 1)];
+    while (*b != f)
+        b = &(*b)->chain;
+    *b = f->chain;
+    unlinkAge(f);
+    cache.count--;
+    cache.bytes -= f->size;
+    releaseForm(f);
+}
+
+cmdLine *parseCachedCmdLines(const char *strLine)
+{
+    const char *text;
+    cmdLine *head;
+    lineForm *f, **b;
+    size_t len;
+    unsigned hash;
+
+    if (!strLine)
+        return NULL;
+    len = strlen(strLine);
+    if (!cache.capacity)
+        return parseCmdLines(strLine);
+    if (len > LINE_CACHE_MAX_LINE) {
+        cache.misses++;
+        return parseCmdLines(strLine);
+    }
+    if (!cache.buckets) {
+        int n = 2;
+        while (n < 2 * cache.capacity)
+            n *= 2;
+        if (!(cache.buckets = (lineForm**) calloc(n, sizeof(lineForm*))))
+            return parseCmdLines(strLine);
+        cache.bucketCount = n;
+    }
+
+    hash = lineHash(strLine, len);
+    b = &cache.buckets[hash & (cache.bucketCount - 1)];
+    for (f = *b; f; f = f->chain)
+        if (f->hash == hash && f->len == len && memcmp(formKey(f), strLine, len) == 0) {
+            cache.hits++;
+            unlinkAge(f);
+            pushNewest(f);
+            return cloneForm(f);
+        }
+
+    cache.misses++;
+    head = parseLine(strLine, &text);
+    /* a line seen once doesn't get a slot: one-off lines would cost a form */
+    /* each and push out the ones that do repeat */
+    if (cache.seen[hash & (LINE_CACHE_SEEN - 1)] != hash) {
+        cache.seen[hash & (LINE_CACHE_SEEN - 1)] = hash;
+        return head;
+    }
+    /* empty lines aren't worth a slot */
+    if (!head || !(f = makeForm(head, strLine, len, text, hash)))
+        return head;
+    if (cache.count == cache.capacity) {
+        evictOldest();
+        cache.evictions++;
+    }
+    f->chain = *b;
+    *b = f;
+    cache.count++;
+    cache.bytes += f->size;
+    pushNewest(f);
+    return head;
+}
+
+void setLineCacheSize(int entries)
+{
+    while (cache.oldest)
+        evictOldest();
+    FREE(cache.buckets);
+    cache.buckets = NULL;
+    memset(cache.seen, 0, sizeof(cache.seen));
+    cache.capacity = entries > 0 ? entries : 0;
+}
+
+void getLineCacheStats(lineCacheStats *stats)
+{
+    stats->hits = cache.hits;
+    stats->misses = cache.misses;
+    stats->evictions = cache.evictions;
+    stats->entries = cache.count;
+    stats->capacity = cache.capacity;
+    stats->bytes = cache.bytes;
+}
+
+void resetLineCacheStats(void)
+{
+    cache.hits = cache.misses = cache.evictions = 0;
+}
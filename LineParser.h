@@ -1,24 +1,67 @@
-#define MAX_ARGUMENTS 256
-
-typedef struct cmdLine
-{
-    char * const arguments[MAX_ARGUMENTS]; /* command line arguments (arg 0 is the command)*/
-    int argCount;		/* number of arguments */
-    char const *inputRedirect;	/* input redirection path. NULL if no input redirection */
-    char const *outputRedirect;	/* output redirection path. NULL if no output redirection */
-    char blocking;	/* boolean indicating blocking/non-blocking */
-    int idx;				/* index of current command in the chain of cmdLines (0 for the first) */
-    struct cmdLine *next;	/* next cmdLine in chain */
-} cmdLine;
-
-/* Parses a given string to arguments and other indicators */
-/* Returns NULL when there's nothing to parse */ 
-/* When successful, returns a pointer to cmdLine (in case of a pipe, this will be the head of a linked list) */
-cmdLine *parseCmdLines(const char *strLine);	/* Parse string line */
-
-/* Releases all allocated memory for the chain (linked list) */
-void freeCmdLines(cmdLine *pCmdLine);		/* Free parsed line */
-
-/* Replaces arguments[num] with newString */
-/* Returns 0 if num is out-of-range, otherwise - returns 1 */
-int replaceCmdArg(cmdLine *pCmdLine, int num, const char *newString);
+#include <stddef.h>
+
+typedef struct cmdLine
+{
+    char * const *arguments;	/* command line arguments (arg 0 is the command), NULL-terminated */
+    int argCount;		/* number of arguments */
+    char const *inputRedirect;	/* input redirection path. NULL if no input redirection */
+    char const *outputRedirect;	/* output redirection path. NULL if no output redirection */
+    char const *hereDelim;	/* <<WORD here-document: the line that ends it. NULL if none */
+    char const *hereText;	/* <<<word here-string, or the here-document body once read. NULL if none */
+    char blocking;	/* boolean indicating blocking/non-blocking */
+    int idx;				/* index of current command in the chain of cmdLines (0 for the first) */
+    struct cmdLine *next;	/* next cmdLine in chain */
+    struct lineArena *arena;	/* single allocation owning every node, string and argv of the line */
+} cmdLine;
+
+/* Parses a given string to arguments and other indicators */
+/* Returns NULL when there's nothing to parse */ 
+/* When successful, returns a pointer to cmdLine (in case of a pipe, this will be the head of a linked list) */
+/* The whole chain lives in one arena: tokens are slices of the arena's copy of the line */
+cmdLine *parseCmdLines(const char *strLine);	/* Parse string line */
+
+/* Releases the nodes of the chain (linked list) */
+/* Nodes detached from the same line may be released separately; */
+/* the arena is freed with a single free once its last node is released */
+void freeCmdLines(cmdLine *pCmdLine);		/* Free parsed line */
+
+/* Sets the body of a <<WORD here-document, read by the caller after parsing */
+/* Returns 0 on allocation failure, otherwise - returns 1 */
+int setHereDoc(cmdLine *pCmdLine, const char *body);
+
+/* Replaces arguments[num] with count arguments (none to drop it), copied */
+/* into the line's arena; the argv array is reallocated there as well. */
+/* Strings shared with the line cache are never written */
+/* Returns 0 if num is out-of-range or on allocation failure, otherwise - returns 1 */
+int spliceCmdArg(cmdLine *pCmdLine, int num, char *const *newArgs, int count);
+
+/* Given s just past the "$(" of a command substitution, returns the ')' */
+/* that closes it (nested parentheses are counted), or the NUL ending s */
+const char *substitutionEnd(const char *s);
+
+/* Replaces arguments[num] with newString, copied into the line's arena: */
+/* a line from the cache gets its own copy instead of changing the shared one */
+/* Returns 0 if num is out-of-range, otherwise - returns 1 */
+int replaceCmdArg(cmdLine *pCmdLine, int num, const char *newString);
+
+/* Parses like parseCmdLines through an LRU cache keyed by the line's text. */
+/* A hit copies no text and doesn't tokenize: the nodes and argv arrays are */
+/* built from the cached form, and the strings are shared with it until the */
+/* line is freed. Lines over 4 KB always go to the parser */
+cmdLine *parseCachedCmdLines(const char *strLine);
+
+typedef struct
+{
+    long hits;
+    long misses;
+    long evictions;
+    int entries;	/* lines cached now */
+    int capacity;	/* 0 when the cache is off */
+    size_t bytes;	/* held by the cached lines */
+} lineCacheStats;
+
+/* Empties the cache and sets how many lines it keeps, 0 to turn it off */
+/* (64 by default) */
+void setLineCacheSize(int entries);
+void getLineCacheStats(lineCacheStats *stats);
+void resetLineCacheStats(void);
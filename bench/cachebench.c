@@ -0,0 +1,101 @@
+// Parsed-line cache: a script replayed line by line through
+// parseCachedCmdLines, with the cache off and at a few sizes. The default
+// script is what a generator emits for a build loop: the same few lines
+// every iteration, plus two naming that iteration's file. A file (a real
+// script, a history file) is replayed instead, one command per line.
+// Each round replays it once into an empty cache, as a new shell would.
+// Only parsing is timed, as the commands themselves would swamp it.
+// Prints CSV on stdout: bench,case,iterations,value,unit
+//
+// usage: cachebench [rounds] [script-file]
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../myshell.h"
+
+static const char *body[] = {
+    "cd /tmp/build",
+    "echo compiling module",
+    "gcc -Wall -g -O2 -Iinclude -c src/mod%03d.c -o obj/mod%03d.o",
+    "grep -c TODO src/mod%03d.c >> todo.log",
+    "printf '%%s\\n' done",
+    "cat build.log | grep -v warning | sort | uniq -c | sort -rn | head -5",
+    "test -f obj/main.o",
+    "sleep 0 &",
+};
+
+static char **generated(int iterations, int *n)
+{
+    int per = sizeof(body) / sizeof(body[0]);
+    char **lines = malloc(iterations * per * sizeof(char *));
+    for (int i = 0; i < iterations; i++)
+        for (int k = 0; k < per; k++)
+            if (asprintf(&lines[i * per + k], body[k], i, i) < 0)
+                exit(1);
+    *n = iterations * per;
+    return lines;
+}
+
+static char **readScript(const char *path, int *n)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    int cap = 1024;
+    char **lines = malloc(cap * sizeof(char *));
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    *n = 0;
+    while ((len = getline(&line, &size, f)) != -1) {
+        if (len && line[len - 1] == '\n')
+            line[--len] = '\0';
+        if (!len || line[0] == '#')
+            continue;
+        if (*n == cap)
+            lines = realloc(lines, (cap *= 2) * sizeof(char *));
+        lines[(*n)++] = strdup(line);
+    }
+    free(line);
+    fclose(f);
+    return lines;
+}
+
+int main(int argc, char **argv)
+{
+    static const int sizes[] = { 0, 8, 64, 512 };
+    int rounds = argc > 1 ? atoi(argv[1]) : 20;
+    int n;
+    char **lines = argc > 2 ? readScript(argv[2], &n) : generated(500, &n);
+
+    printf("bench,case,iterations,value,unit\n");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        char name[32];
+        lineCacheStats c;
+        if (sizes[s])
+            snprintf(name, sizeof(name), "cache=%d", sizes[s]);
+        else
+            strcpy(name, "off");
+        resetLineCacheStats();
+        long start = nowNanos();
+        for (int r = 0; r < rounds; r++) {
+            setLineCacheSize(sizes[s]);     // each round is a fresh shell
+            for (int i = 0; i < n; i++)
+                freeCmdLines(parseCachedCmdLines(lines[i]));
+        }
+        long ns = nowNanos() - start;
+        getLineCacheStats(&c);
+        printf("linecache,%s,%d,%.3f,us/line\n", name, n * rounds, ns / 1e3 / n / rounds);
+        if (sizes[s])
+            printf("linecache,%s,%d,%.1f,%% hits\n", name, n * rounds,
+                   100.0 * c.hits / (c.hits + c.misses));
+    }
+    setLineCacheSize(0);
+    for (int i = 0; i < n; i++)
+        free(lines[i]);
+    free(lines);
+    return 0;
+}
@@ -0,0 +1,37 @@
+// Launch-to-exit latency of execute(): a blocking /bin/true through the
+// shell's own launch, job table and signalfd wait, for each backend.
+// Prints CSV on stdout: bench,case,iterations,value,unit
+//
+// usage: execbench [iterations]
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "../myshell.h"
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+
+    if (!zygoteStart()) {
+        perror("zygote");
+        return 1;
+    }
+    initSignals();
+    printf("bench,case,iterations,value,unit\n");
+    for (launchBackend b = LAUNCH_FORK; b <= LAUNCH_ZYGOTE; b++) {
+        initLaunch(b, &shell_sigmask, false);
+        long start = nowNanos();
+        for (int i = 0; i < iterations; i++) {
+            if (execute(parseCmdLines("true")) != 0) {
+                fprintf(stderr, "true failed\n");
+                return 1;
+            }
+            removeTerminatedProcesses(&process_list);
+        }
+        printf("execute,%s,%d,%.1f,us/command\n", launchBackendName(b), iterations,
+               (nowNanos() - start) / 1e3 / iterations);
+    }
+    freeProcessList(&process_list);
+    zygoteStop();
+    return 0;
+}
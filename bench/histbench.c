@@ -0,0 +1,82 @@
+// Shared history startup cost: time to open a history file and resolve
+// the last and a random entry (what !! and !n do), at growing sizes.
+// Startup should stay flat because nothing is loaded eagerly. Prints CSV
+// on stdout: bench,case,iterations,value,unit
+//
+// usage: histbench [dir]
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "../histfile.h"
+
+static long nowNanos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Writes n entries straight in the on-disk format; going through
+// histFileAppend would only make the setup slower.
+static void fill(const char *path, long n)
+{
+    char idxPath[4200], cmd[128];
+    char header[HISTFILE_HEADER] = HISTFILE_MAGIC;
+    FILE *data = fopen(path, "w");
+    snprintf(idxPath, sizeof(idxPath), "%s.idx", path);
+    FILE *idx = fopen(idxPath, "w");
+    uint64_t off = 0;
+
+    header[8] = HISTFILE_VERSION;
+    fwrite(header, 1, sizeof(header), idx);
+    for (long i = 0; i < n; i++) {
+        int len = snprintf(cmd, sizeof(cmd), "grep -n pattern%ld /var/log/app/%ld.log | sort", i, i % 97) + 1;
+        fwrite(cmd, 1, len, data);
+        fwrite(&off, sizeof(off), 1, idx);
+        off += len;
+    }
+    fclose(data);
+    fclose(idx);
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = argc > 1 ? argv[1] : "/tmp";
+    long sizes[] = { 1000, 10000, 100000, 1000000 };
+    char path[4000], idxPath[4096];
+
+    printf("bench,case,iterations,value,unit\n");
+    for (int i = 0; i < 4; i++) {
+        snprintf(path, sizeof(path), "%s/histbench.%d", dir, (int)getpid());
+        snprintf(idxPath, sizeof(idxPath), "%s.idx", path);
+        fill(path, sizes[i]);
+
+        long t0 = nowNanos();
+        histFile *h = histFileOpen(path);
+        long t1 = nowNanos();
+        const char *last = histFileGet(h, histFileCount(h));
+        long t2 = nowNanos();
+        const char *any = histFileGet(h, 1 + random() % sizes[i]);
+        long t3 = nowNanos();
+        histFileAppend(h, "echo appended");
+        long t4 = nowNanos();
+        if (!last || !any) {
+            fprintf(stderr, "lookup failed at %ld entries\n", sizes[i]);
+            return 1;
+        }
+        printf("histfile,open entries=%ld,1,%.1f,us\n", sizes[i], (t1 - t0) / 1e3);
+        printf("histfile,last entries=%ld,1,%.1f,us\n", sizes[i], (t2 - t1) / 1e3);
+        printf("histfile,random entries=%ld,1,%.1f,us\n", sizes[i], (t3 - t2) / 1e3);
+        printf("histfile,append entries=%ld,1,%.1f,us\n", sizes[i], (t4 - t3) / 1e3);
+
+        histFileClose(h);
+        unlink(path);
+        unlink(idxPath);
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+// Job table scaling: cost of updateProcessList with N background jobs,
+// first while none of them changes state, then reaping all N at once,
+// and the heap each live job holds on to.
+// Prints CSV on stdout: bench,case,iterations,value,unit
+//
+// usage: jobbench [N...]
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <malloc.h>
+#include "../myshell.h"
+
+int main(int argc, char **argv)
+{
+    int defaults[] = { 10, 100, 1000, 4000 };
+    int ncases = argc > 1 ? argc - 1 : 4;
+    int polls = 10000;
+
+    initSignals();
+    initLaunch(LAUNCH_SPAWN, &shell_sigmask, false);
+    printf("bench,case,iterations,value,unit\n");
+    for (int c = 0; c < ncases; c++) {
+        int n = argc > 1 ? atoi(argv[c + 1]) : defaults[c];
+        size_t heap = mallinfo2().uordblks;
+        for (int i = 0; i < n; i++)
+            execute(parseCmdLines("sleep 600 &"));
+        updateProcessList(&process_list);
+        printf("jobs,heap N=%d,%d,%.1f,bytes/job\n", n, n,
+               (double)(mallinfo2().uordblks - heap) / n);
+
+        long start = nowNanos();
+        for (int i = 0; i < polls; i++)
+            updateProcessList(&process_list);
+        printf("jobs,idle N=%d,%d,%.2f,us/update\n", n, polls, (nowNanos() - start) / 1e3 / polls);
+
+        for (process *p = process_list.head; p; p = p->next)
+            kill(p->pid, SIGKILL);
+        start = nowNanos();
+        int left = n;
+        while (left > 0) {
+            updateProcessList(&process_list);
+            left = 0;
+            for (process *p = process_list.head; p; p = p->next)
+                left += p->status != TERMINATED;
+        }
+        printf("jobs,reap N=%d,%d,%.2f,us/job\n", n, n, (nowNanos() - start) / 1e3 / n);
+        removeTerminatedProcesses(&process_list);
+    }
+    freeProcessList(&process_list);
+    return 0;
+}
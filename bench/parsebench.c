@@ -0,0 +1,116 @@
+// Parser cost: parseCmdLines + freeCmdLines over a corpus of command lines,
+// the built-in one below or one line per line of a file. Without a file,
+// generated 100 KB and 1 MB lines (argument lists as xargs-style tools
+// produce them) are timed too. Prints CSV on stdout:
+// bench,case,iterations,value,unit
+//
+// usage: parsebench [rounds] [corpus-file]
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../myshell.h"
+
+static const char *builtin[] = {
+    "ls -l",
+    "cd /var/log",
+    "grep -n ERROR /var/log/syslog | cut -d: -f1 | sort | uniq -c | sort -n",
+    "cat access.log | awk '{print $1}' | sort | uniq -c | sort -rn | head -20",
+    "make -j8 all > build.log",
+    "sort < names.txt > sorted.txt",
+    "tar czf backup.tgz /etc /home/user/projects",
+    "find . -name '*.c' -newer Makefile",
+    "sleep 30 &",
+    "git log --oneline --graph --decorate --all",
+    "ps aux | grep myshell | grep -v grep",
+    "wc -l < /etc/passwd",
+    "curl -s http://localhost:8080/health",
+    "gcc -Wall -g -O2 -c myshell.c -o myshell.o",
+    "procs",
+    "echo one two three four five six seven eight nine ten",
+};
+
+// One generated line of about len bytes: cmd followed by words of wordLen
+// characters, e.g. "rm f000001.o f000002.o ..." for short words.
+static char *longLine(const char *cmd, size_t len, int wordLen)
+{
+    char *line = malloc(len + wordLen + 2), *p = line;
+    p += sprintf(p, "%s", cmd);
+    for (int n = 0; (size_t)(p - line) < len; n++) {
+        int w = sprintf(p, " f%07d", n);
+        memset(p + w, 'x', wordLen > w ? wordLen - w : 0);
+        p += wordLen > w ? wordLen : w;
+    }
+    *p = '\0';
+    return line;
+}
+
+static void timeLine(const char *name, const char *line, int rounds)
+{
+    size_t bytes = strlen(line);
+    long start = nowNanos();
+    for (int r = 0; r < rounds; r++)
+        freeCmdLines(parseCmdLines(line));
+    long ns = nowNanos() - start;
+    printf("parse,%s,%d,%.1f,us/line\n", name, rounds, ns / 1e3 / rounds);
+    printf("parse,%s,%d,%.1f,MB/s\n", name, rounds, bytes * rounds / (ns / 1e3));
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 20000;
+    const char **corpus = builtin;
+    int lines = sizeof(builtin) / sizeof(builtin[0]);
+    const char *name = "builtin";
+    long bytes = 0;
+
+    if (argc > 2) {
+        FILE *f = fopen(argv[2], "r");
+        char *line = NULL;
+        size_t cap = 0;
+        int n = 0, max = 1024;
+        if (!f) {
+            perror(argv[2]);
+            return 1;
+        }
+        corpus = malloc(max * sizeof(char *));
+        while (getline(&line, &cap, f) > 0) {
+            if (n == max)
+                corpus = realloc(corpus, (max *= 2) * sizeof(char *));
+            corpus[n++] = strdup(line);
+        }
+        free(line);
+        fclose(f);
+        lines = n;
+        name = argv[2];
+    }
+    for (int i = 0; i < lines; i++)
+        bytes += strlen(corpus[i]);
+
+    long start = nowNanos();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < lines; i++)
+            freeCmdLines(parseCmdLines(corpus[i]));
+    }
+    long ns = nowNanos() - start;
+    long total = (long)rounds * lines;
+
+    printf("bench,case,iterations,value,unit\n");
+    printf("parse,%s,%ld,%.1f,ns/line\n", name, total, (double)ns / total);
+    printf("parse,%s,%ld,%.1f,MB/s\n", name, total, bytes * rounds / (ns / 1e3));
+
+    if (argc > 2)
+        return 0;
+    static const struct { const char *name; size_t len; int wordLen; int rounds; } big[] = {
+        { "args-100K", 100 * 1024, 9, 2000 },          // short words: mostly separators
+        { "args-1M", 1024 * 1024, 9, 200 },
+        { "longwords-100K", 100 * 1024, 200, 2000 },   // -Dkey=value flags, paths
+        { "longwords-1M", 1024 * 1024, 200, 200 },
+    };
+    for (size_t i = 0; i < sizeof(big) / sizeof(big[0]); i++) {
+        char *line = longLine("cmd", big[i].len, big[i].wordLen);
+        timeLine(big[i].name, line, big[i].rounds * rounds / 20000 + 1);
+        free(line);
+    }
+    return 0;
+}
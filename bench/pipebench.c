@@ -0,0 +1,77 @@
+// runPipeline throughput: bytes per second pushed through "cat file | wc -c"
+// (the in-shell sendfile feeder) and "dd ... | wc -c" (an external writer),
+// at each pipe buffer size of "set pipebuf", with the context switches
+// of the shell and its children per run.
+// Prints CSV on stdout: bench,case,iterations,value,unit
+//
+// usage: pipebench [MB] [runs]
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "../myshell.h"
+
+// voluntary and involuntary, of the shell and its reaped children
+static long contextSwitches(void)
+{
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    return self.ru_nvcsw + self.ru_nivcsw + children.ru_nvcsw + children.ru_nivcsw;
+}
+
+int main(int argc, char **argv)
+{
+    int mb = argc > 1 ? atoi(argv[1]) : 256;
+    int runs = argc > 2 ? atoi(argv[2]) : 5;
+    char path[] = "/tmp/pipebenchXXXXXX";
+    char line[256];
+    char block[1 << 16];
+
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        perror("mkstemp");
+        return 1;
+    }
+    memset(block, 'x', sizeof(block));
+    for (long left = (long)mb << 20; left > 0; left -= sizeof(block)) {
+        if (write(fd, block, sizeof(block)) != sizeof(block)) {
+            perror("write");
+            unlink(path);
+            return 1;
+        }
+    }
+    close(fd);
+
+    initSignals();
+    initLaunch(LAUNCH_SPAWN, &shell_sigmask, false);
+    const char *producers[][2] = {
+        { "cat", "cat %s | wc -c > /dev/null" },
+        { "dd", "dd if=%s bs=1M status=none | wc -c > /dev/null" },
+    };
+    const int sizes[] = { 64 << 10, 256 << 10, 1 << 20 };
+
+    printf("bench,case,iterations,value,unit\n");
+    for (int p = 0; p < 2; p++) {
+        snprintf(line, sizeof(line), producers[p][1], path);
+        runPipeline(parseCmdLines(line));   // warm the page cache
+        for (int s = 0; s < 3; s++) {
+            settings.pipebuf = sizes[s];
+            long before = contextSwitches();
+            long start = nowNanos();
+            for (int i = 0; i < runs; i++)
+                runPipeline(parseCmdLines(line));
+            double secs = (nowNanos() - start) / 1e9;
+            printf("pipeline,%s|wc %dMB pipebuf=%dK,%d,%.1f,MB/s\n",
+                   producers[p][0], mb, sizes[s] >> 10, runs, mb * runs / secs);
+            printf("pipeline,%s|wc %dMB pipebuf=%dK switches,%d,%.0f,csw/run\n",
+                   producers[p][0], mb, sizes[s] >> 10, runs,
+                   (double)(contextSwitches() - before) / runs);
+        }
+    }
+    freeProcessList(&process_list);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,70 @@
+// Spawn latency: launch-to-reap time of /bin/true with each launch backend,
+// measured with a small and with a large, fully touched parent heap so the
+// page-table copy of fork() shows up. The zygote helper is forked before
+// the heap grows, as the shell does at startup. Prints CSV on stdout:
+// bench,case,iterations,value,unit
+//
+// usage: spawnbench [iterations] [heap MB...]
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "../launch.h"
+#include "../zygote.h"
+
+static long nowNanos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static double measure(launchBackend backend, int iterations)
+{
+    char *argv[] = { "true", NULL };
+    launchSpec spec = { .path = "/bin/true", .argv = argv, .in_fd = -1, .out_fd = -1 };
+    long start = nowNanos();
+    for (int i = 0; i < iterations; i++) {
+        pid_t pid = launchWith(backend, &spec);
+        if (pid < 0) {
+            perror("launch");
+            exit(1);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    return (nowNanos() - start) / 1000.0 / iterations;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    int defaults[] = { 0, 256 };
+    int nheaps = argc > 2 ? argc - 2 : 2;
+
+    initLaunch(LAUNCH_SPAWN, NULL, true);
+    if (!zygoteStart()) {
+        perror("zygote");
+        return 1;
+    }
+    printf("bench,case,iterations,value,unit\n");
+    for (int h = 0; h < nheaps; h++) {
+        int mb = argc > 2 ? atoi(argv[h + 2]) : defaults[h];
+        char *heap = NULL;
+        if (mb > 0) {
+            heap = malloc((size_t)mb << 20);
+            if (!heap) {
+                perror("malloc");
+                return 1;
+            }
+            memset(heap, 1, (size_t)mb << 20);
+        }
+        for (launchBackend b = LAUNCH_FORK; b <= LAUNCH_ZYGOTE; b++)
+            printf("spawn,%s heap=%dMB,%d,%.1f,us/launch\n", launchBackendName(b), mb,
+                   iterations, measure(b, iterations));
+        free(heap);
+    }
+    zygoteStop();
+    return 0;
+}
@@ -0,0 +1,58 @@
+// Command substitution cost: a line with $(...) nested 1-3 deep, expanded
+// and dispatched as the shell does it. The in-process echo cases show the
+// capture overhead itself (memfd, stdout swap, splitting); the /bin/echo
+// cases add a launch per level; seq shows the cost of a large capture.
+// Prints CSV on stdout: bench,case,iterations,value,unit
+//
+// usage: substbench [iterations]
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/limits.h>
+#include "../myshell.h"
+
+static const struct {
+    const char *name;
+    const char *line;
+    int scale;      // iterations divisor for the expensive cases
+} cases[] = {
+    { "builtin-depth1", "true $(echo x)", 1 },
+    { "builtin-depth2", "true $(echo $(echo x))", 1 },
+    { "builtin-depth3", "true $(echo $(echo $(echo x)))", 1 },
+    { "external-depth1", "true $(/bin/echo x)", 4 },
+    { "external-depth2", "true $(/bin/echo $(/bin/echo x))", 4 },
+    { "external-depth3", "true $(/bin/echo $(/bin/echo $(/bin/echo x)))", 4 },
+    { "seq-100000", "true $(seq 100000)", 40 },
+};
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 4000;
+    char cwd[PATH_MAX];
+
+    if (!getcwd(cwd, sizeof(cwd))) {
+        perror("getcwd");
+        return 1;
+    }
+    initSignals();
+    initLaunch(LAUNCH_SPAWN, &shell_sigmask, false);
+    printf("bench,case,iterations,value,unit\n");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int n = iterations / cases[i].scale + 1;
+        long start = nowNanos();
+        for (int k = 0; k < n; k++) {
+            cmdLine *c = parseCmdLines(cases[i].line);
+            if (!expandSubstitutions(c, cwd)) {
+                fprintf(stderr, "%s: expansion failed\n", cases[i].line);
+                return 1;
+            }
+            dispatchCommand(c, cwd);
+            removeTerminatedProcesses(&process_list);
+        }
+        printf("subst,%s,%d,%.1f,us/line\n", cases[i].name, n, (nowNanos() - start) / 1e3 / n);
+    }
+    freeProcessList(&process_list);
+    return 0;
+}
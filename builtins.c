@@ -0,0 +1,262 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "builtins.h"
+
+int echoUtility(int argc, char *const argv[], FILE *out)
+{
+    int i = 1;
+    bool newline = true;
+    if (i < argc && strcmp(argv[i], "-n") == 0) {
+        newline = false;
+        i++;
+    }
+    for (; i < argc; i++) {
+        fputs(argv[i], out);
+        if (i + 1 < argc)
+            fputc(' ', out);
+    }
+    if (newline)
+        fputc('\n', out);
+    return 0;
+}
+
+int trueUtility(int argc, char *const argv[], FILE *out)
+{
+    (void)argc, (void)argv, (void)out;
+    return 0;
+}
+
+int falseUtility(int argc, char *const argv[], FILE *out)
+{
+    (void)argc, (void)argv, (void)out;
+    return 1;
+}
+
+// Write the escape starting after a backslash at *s and advance past it.
+static void putEscape(const char **s, FILE *out)
+{
+    static const char from[] = "abfnrtv\\\"", to[] = "\a\b\f\n\r\t\v\\\"";
+    const char *p = *s;
+    const char *hit = *p ? strchr(from, *p) : NULL;
+    if (hit) {
+        fputc(to[hit - from], out);
+        *s = p + 1;
+    }
+    else if (*p >= '0' && *p <= '7') {
+        // \NNN, or \0NNN as in %b
+        int value = 0, digits = *p == '0' ? 4 : 3;
+        for (; digits-- && *p >= '0' && *p <= '7'; p++)
+            value = value * 8 + (*p - '0');
+        fputc(value, out);
+        *s = p;
+    }
+    else
+        fputc('\\', out);   // unknown: keep the backslash, the char follows
+}
+
+// A numeric printf argument; bad ones print a warning and fail the command.
+static bool numericArg(const char *arg, long long *value, int *status)
+{
+    char *end;
+    errno = 0;
+    if (!arg || !*arg) {
+        *value = 0;
+        return true;
+    }
+    if (arg[0] == '\'' || arg[0] == '"') {
+        *value = (unsigned char)arg[1];    // 'c is the code of c
+        return true;
+    }
+    *value = strtoll(arg, &end, 0);
+    if (*end || errno) {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *status = 1;
+    }
+    return true;
+}
+
+int printfUtility(int argc, char *const argv[], FILE *out)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: printf format [arg...]\n");
+        return 2;
+    }
+    const char *format = argv[1];
+    int arg = 2, status = 0;
+    for (;;) {
+        int first = arg;
+        for (const char *p = format; *p; ) {
+            if (*p == '\\') {
+                p++;
+                putEscape(&p, out);
+                continue;
+            }
+            if (*p != '%') {
+                fputc(*p++, out);
+                continue;
+            }
+            if (p[1] == '%') {
+                fputc('%', out);
+                p += 2;
+                continue;
+            }
+            // %[flags][width][.precision]conversion, rebuilt for stdio
+            char spec[40];
+            size_t n = 0;
+            spec[n++] = *p++;
+            while (*p && strchr("-+ #0", *p) && n < 8)
+                spec[n++] = *p++;
+            while (isdigit((unsigned char)*p) && n < 16)
+                spec[n++] = *p++;
+            if (*p == '.') {
+                spec[n++] = *p++;
+                while (isdigit((unsigned char)*p) && n < 24)
+                    spec[n++] = *p++;
+            }
+            char conv = *p ? *p++ : '\0';
+            const char *a = arg < argc ? argv[arg++] : NULL;
+            long long value;
+            switch (conv) {
+                case 'd': case 'i':
+                    numericArg(a, &value, &status);
+                    strcpy(spec + n, "lld");
+                    fprintf(out, spec, value);
+                    break;
+                case 'u': case 'o': case 'x': case 'X':
+                    numericArg(a, &value, &status);
+                    spec[n++] = 'l';
+                    spec[n++] = 'l';
+                    spec[n++] = conv;
+                    spec[n] = '\0';
+                    fprintf(out, spec, (unsigned long long)value);
+                    break;
+                case 'f': case 'e': case 'E': case 'g': case 'G':
+                    spec[n++] = conv;
+                    spec[n] = '\0';
+                    fprintf(out, spec, a ? strtod(a, NULL) : 0.0);
+                    break;
+                case 'c':
+                    if (a && *a)
+                        fputc(*a, out);
+                    break;
+                case 's':
+                    strcpy(spec + n, "s");
+                    fprintf(out, spec, a ? a : "");
+                    break;
+                case 'b':
+                    for (const char *s = a ? a : ""; *s; ) {
+                        if (*s == '\\') {
+                            s++;
+                            putEscape(&s, out);
+                        }
+                        else
+                            fputc(*s++, out);
+                    }
+                    break;
+                default:
+                    fprintf(stderr, "printf: %%%c: invalid directive\n", conv);
+                    return 1;
+            }
+        }
+        // the format is reused while it consumes the remaining arguments
+        if (arg >= argc || arg == first)
+            return status;
+    }
+}
+
+static bool integer(const char *s, long long *value)
+{
+    char *end;
+    errno = 0;
+    *value = strtoll(s, &end, 10);
+    if (!*s || *end || errno) {
+        fprintf(stderr, "test: %s: integer expression expected\n", s);
+        return false;
+    }
+    return true;
+}
+
+// 0 true, 1 false, 2 error, as test's exit status
+static int evalTest(int n, char *const a[])
+{
+    struct stat st;
+    if (n == 0)
+        return 1;
+    if (strcmp(a[0], "!") == 0 && n > 1) {
+        int r = evalTest(n - 1, a + 1);
+        return r == 2 ? 2 : !r;
+    }
+    if (n == 1)
+        return a[0][0] ? 0 : 1;
+    if (n == 2) {
+        const char *op = a[0], *s = a[1];
+        if (strcmp(op, "-n") == 0) return !*s;
+        if (strcmp(op, "-z") == 0) return *s != '\0';
+        if (strcmp(op, "-L") == 0 || strcmp(op, "-h") == 0)
+            return !(lstat(s, &st) == 0 && S_ISLNK(st.st_mode));
+        if (strcmp(op, "-r") == 0) return access(s, R_OK) != 0;
+        if (strcmp(op, "-w") == 0) return access(s, W_OK) != 0;
+        if (strcmp(op, "-x") == 0) return access(s, X_OK) != 0;
+        bool found = stat(s, &st) == 0;
+        if (strcmp(op, "-e") == 0) return !found;
+        if (strcmp(op, "-f") == 0) return !(found && S_ISREG(st.st_mode));
+        if (strcmp(op, "-d") == 0) return !(found && S_ISDIR(st.st_mode));
+        if (strcmp(op, "-s") == 0) return !(found && st.st_size > 0);
+        fprintf(stderr, "test: %s: unary operator expected\n", op);
+        return 2;
+    }
+    if (n == 3) {
+        const char *op = a[1];
+        if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+            return strcmp(a[0], a[2]) != 0;
+        if (strcmp(op, "!=") == 0)
+            return strcmp(a[0], a[2]) == 0;
+        static const char *ops[] = { "-eq", "-ne", "-lt", "-le", "-gt", "-ge" };
+        for (int i = 0; i < 6; i++) {
+            if (strcmp(op, ops[i]) != 0)
+                continue;
+            long long l, r;
+            if (!integer(a[0], &l) || !integer(a[2], &r))
+                return 2;
+            bool result[] = { l == r, l != r, l < r, l <= r, l > r, l >= r };
+            return !result[i];
+        }
+        fprintf(stderr, "test: %s: binary operator expected\n", op);
+        return 2;
+    }
+    fprintf(stderr, "test: too many arguments\n");
+    return 2;
+}
+
+int testUtility(int argc, char *const argv[], FILE *out)
+{
+    (void)out;
+    if (strcmp(argv[0], "[") == 0) {
+        if (strcmp(argv[argc - 1], "]") != 0) {
+            fprintf(stderr, "[: missing ]\n");
+            return 2;
+        }
+        argc--;
+    }
+    return evalTest(argc - 1, argv + 1);
+}
+
+int pwdUtility(int argc, char *const argv[], FILE *out)
+{
+    char cwd[PATH_MAX];
+    (void)argc, (void)argv;
+    if (!getcwd(cwd, sizeof(cwd))) {
+        perror("pwd");
+        return 1;
+    }
+    fprintf(out, "%s\n", cwd);
+    return 0;
+}
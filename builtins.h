@@ -0,0 +1,24 @@
+/* Trivial utilities the shell runs in-process instead of fork+exec */
+/* Each writes its output to out and its diagnostics to stderr, and */
+/* returns the exit status the standalone program would */
+#include <stdio.h>
+
+typedef int (*utilityFn)(int argc, char *const argv[], FILE *out);
+
+/* echo [-n] [arg...] */
+int echoUtility(int argc, char *const argv[], FILE *out);
+
+/* true, false */
+int trueUtility(int argc, char *const argv[], FILE *out);
+int falseUtility(int argc, char *const argv[], FILE *out);
+
+/* printf format [arg...]: %d %i %u %o %x %X %c %s %b %f %e %g and %% */
+/* with flags, width and precision; the format is reused for extra args */
+int printfUtility(int argc, char *const argv[], FILE *out);
+
+/* test expr, [ expr ]: !, -n -z -e -f -d -r -w -x -s -L, */
+/* = != and -eq -ne -lt -le -gt -ge */
+int testUtility(int argc, char *const argv[], FILE *out);
+
+/* pwd */
+int pwdUtility(int argc, char *const argv[], FILE *out);
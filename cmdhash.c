@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "cmdhash.h"
+
+#define HASH_BUCKETS 256
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | \
+                    IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct cmdEntry {
+    char *name;
+    char *path;
+    long hits;
+    struct cmdEntry *next;
+} cmdEntry;
+
+static cmdEntry *buckets[HASH_BUCKETS];
+static char *cachedPath = NULL;     /* PATH the table was built against */
+static int inotifyFd = -1;
+
+static unsigned hashName(const char *s)
+{
+    unsigned h = 2166136261u;
+    while (*s)
+        h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h % HASH_BUCKETS;
+}
+
+static void freeEntry(cmdEntry *e)
+{
+    free(e->name);
+    free(e->path);
+    free(e);
+}
+
+void clearCommandHash(void)
+{
+    for (int i = 0; i < HASH_BUCKETS; i++) {
+        cmdEntry *e = buckets[i];
+        while (e) {
+            cmdEntry *next = e->next;
+            freeEntry(e);
+            e = next;
+        }
+        buckets[i] = NULL;
+    }
+}
+
+static void forget(const char *name)
+{
+    cmdEntry **pe = &buckets[hashName(name)];
+    while (*pe) {
+        if (strcmp((*pe)->name, name) == 0) {
+            cmdEntry *e = *pe;
+            *pe = e->next;
+            freeEntry(e);
+            return;
+        }
+        pe = &(*pe)->next;
+    }
+}
+
+// Watch every absolute PATH directory. Relative entries are never cached.
+static void watchPath(const char *path)
+{
+    if (inotifyFd != -1)
+        close(inotifyFd);
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd == -1)
+        return;
+
+    char *copy = strdup(path);
+    if (!copy)
+        return;     // as when inotify is unavailable: nothing is watched
+    for (char *dir = strtok(copy, ":"); dir; dir = strtok(NULL, ":")) {
+        if (dir[0] == '/')
+            inotify_add_watch(inotifyFd, dir, WATCH_MASK);
+    }
+    free(copy);
+}
+
+// Apply pending inotify events. A change to one name only drops that name;
+// a vanished directory or an overflowed queue drops everything.
+static void drainEvents(void)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+
+    if (inotifyFd == -1)
+        return;
+    while ((len = read(inotifyFd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+                clearCommandHash();
+            else if (ev->len)
+                forget(ev->name);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
+
+// Start over whenever PATH differs from the one the table was built for.
+static void checkPath(const char *path)
+{
+    if (cachedPath && strcmp(cachedPath, path) == 0)
+        return;
+    clearCommandHash();
+    free(cachedPath);
+    cachedPath = strdup(path);
+    watchPath(path);
+}
+
+// Walk PATH like execvp does, without the failed execve per miss.
+static cmdEntry *resolve(const char *name, const char *path)
+{
+    char full[PATH_MAX];
+    struct stat st;
+
+    for (const char *p = path; ; ) {
+        const char *colon = strchrnul(p, ':');
+        int dlen = colon - p;
+        if (dlen > 0 && p[0] == '/' &&
+            snprintf(full, sizeof(full), "%.*s/%s", dlen, p, name) < (int)sizeof(full) &&
+            stat(full, &st) == 0 && S_ISREG(st.st_mode) && access(full, X_OK) == 0) {
+            // out of memory: not remembered, execvp searches PATH itself
+            cmdEntry *e = calloc(1, sizeof(cmdEntry));
+            if (!e)
+                return NULL;
+            if (!(e->name = strdup(name)) || !(e->path = strdup(full))) {
+                freeEntry(e);
+                return NULL;
+            }
+            return e;
+        }
+        if (!*colon)
+            return NULL;
+        p = colon + 1;
+    }
+}
+
+const char *lookupCommand(const char *name)
+{
+    const char *path = getenv("PATH");
+
+    if (!name || !*name)
+        return NULL;
+    if (strchr(name, '/'))
+        return name;
+    if (!path)
+        path = "/bin:/usr/bin";
+
+    checkPath(path);
+    drainEvents();
+
+    unsigned h = hashName(name);
+    cmdEntry *e;
+    for (e = buckets[h]; e; e = e->next) {
+        if (strcmp(e->name, name) == 0)
+            break;
+    }
+    if (!e) {
+        if (!(e = resolve(name, path)))
+            return NULL;
+        e->next = buckets[h];
+        buckets[h] = e;
+    }
+    e->hits++;
+    return e->path;
+}
+
+void printCommandHash(void)
+{
+    bool empty = true;
+    drainEvents();
+    for (int i = 0; i < HASH_BUCKETS; i++) {
+        for (cmdEntry *e = buckets[i]; e; e = e->next) {
+            if (empty)
+                printf("hits\tcommand\n");
+            printf("%4ld\t%s\n", e->hits, e->path);
+            empty = false;
+        }
+    }
+    if (empty)
+        printf("hash: hash table empty\n");
+}
+
+void freeCommandHash(void)
+{
+    clearCommandHash();
+    free(cachedPath);
+    cachedPath = NULL;
+    if (inotifyFd != -1)
+        close(inotifyFd);
+    inotifyFd = -1;
+}
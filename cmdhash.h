@@ -0,0 +1,18 @@
+/* Shell-side cache mapping command names to their resolved PATH location */
+/* Entries are filled lazily, dropped when PATH changes and when inotify */
+/* reports a change to that name in one of the PATH directories */
+
+/* Returns the absolute path name resolves to through PATH */
+/* Names containing '/' are returned unchanged. Returns NULL if not found, */
+/* or if it could not be remembered: execvp's own PATH search then applies */
+/* The result is only valid until the next call into this module */
+const char *lookupCommand(const char *name);
+
+/* Forgets every remembered location */
+void clearCommandHash(void);
+
+/* Prints the remembered locations with their hit counts */
+void printCommandHash(void);
+
+/* Releases the table and the inotify watches */
+void freeCommandHash(void);
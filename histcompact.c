@@ -0,0 +1,39 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "histfile.h"
+
+// Rewrites a shared history file, optionally keeping only the newest
+// entries and dropping consecutive duplicates. Shells using the file
+// notice the replacement on their next append and reopen it.
+int main(int argc, char **argv) {
+    long keep = 0;
+    bool dedup = false;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:u")) != -1) {
+        switch (c) {
+            case 'n':
+                keep = atol(optarg);
+                break;
+            case 'u':
+                dedup = true;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n keep] [-u] histfile\n", argv[0]);
+                exit(2);
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-n keep] [-u] histfile\n", argv[0]);
+        exit(2);
+    }
+
+    long kept = histFileCompact(argv[optind], keep, dedup);
+    if (kept < 0)
+        exit(1);
+    fprintf(stderr, "%s: %ld entries\n", argv[optind], kept);
+    return 0;
+}
@@ -0,0 +1,240 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "histfile.h"
+
+static void unmapAll(histFile *h)
+{
+    if (h->data)
+        munmap((void*)h->data, h->dataLen);
+    if (h->idx)
+        munmap((void*)h->idx, h->idxLen);
+    h->data = h->idx = NULL;
+    h->dataLen = h->idxLen = 0;
+}
+
+// Creates the index with its header in one step: a fully written
+// temporary file is linked into place, which fails if another shell won.
+static int createIndex(const char *idxPath)
+{
+    char tmp[4096];
+    char header[HISTFILE_HEADER] = HISTFILE_MAGIC;
+    header[8] = HISTFILE_VERSION;
+
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", idxPath, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1)
+        return -1;
+    if (write(fd, header, sizeof(header)) != sizeof(header)) {
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    close(fd);
+    if (link(tmp, idxPath) == -1 && errno != EEXIST) {
+        unlink(tmp);
+        return -1;
+    }
+    unlink(tmp);
+    return 0;
+}
+
+static bool openFiles(histFile *h)
+{
+    struct stat st;
+
+    h->dataFd = open(h->path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (h->dataFd == -1)
+        return false;
+    h->idxFd = open(h->idxPath, O_RDWR | O_APPEND | O_CLOEXEC);
+    if (h->idxFd == -1 && errno == ENOENT && createIndex(h->idxPath) == 0)
+        h->idxFd = open(h->idxPath, O_RDWR | O_APPEND | O_CLOEXEC);
+    if (h->idxFd == -1 || fstat(h->idxFd, &st) == -1)
+        return false;
+    h->idxIno = st.st_ino;
+    return true;
+}
+
+static void closeFiles(histFile *h)
+{
+    unmapAll(h);
+    if (h->dataFd != -1)
+        close(h->dataFd);
+    if (h->idxFd != -1)
+        close(h->idxFd);
+    h->dataFd = h->idxFd = -1;
+}
+
+histFile *histFileOpen(const char *path)
+{
+    histFile *h = calloc(1, sizeof(histFile));
+    if (!h)
+        return NULL;
+    h->dataFd = h->idxFd = -1;
+    h->path = strdup(path);
+    if (h->path && asprintf(&h->idxPath, "%s.idx", path) == -1)
+        h->idxPath = NULL;
+    if (!h->path || !h->idxPath || !openFiles(h)) {
+        perror(path);
+        histFileClose(h);
+        return NULL;
+    }
+    return h;
+}
+
+void histFileClose(histFile *h)
+{
+    if (!h)
+        return;
+    closeFiles(h);
+    free(h->path);
+    free(h->idxPath);
+    free(h);
+}
+
+// A compaction replaces both files; start over on the new ones.
+static void reopenIfReplaced(histFile *h)
+{
+    struct stat st;
+    if (stat(h->idxPath, &st) == 0 && st.st_ino == h->idxIno)
+        return;
+    closeFiles(h);
+    openFiles(h);
+}
+
+// Extend a read-only mapping of fd to its current size.
+static bool remap(int fd, const char **map, size_t *len)
+{
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1)
+        return false;
+    if ((size_t)st.st_size == *len)
+        return true;
+    void *m = *map ? mremap((void*)*map, *len, st.st_size, MREMAP_MAYMOVE)
+                   : mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) {
+        *map = NULL;
+        *len = 0;
+        return false;
+    }
+    *map = m;
+    *len = st.st_size;
+    return true;
+}
+
+bool histFileAppend(histFile *h, const char *cmd)
+{
+    size_t len = strlen(cmd) + 1;
+    uint64_t off;
+
+    reopenIfReplaced(h);
+    if (h->dataFd == -1 || h->idxFd == -1)
+        return false;
+    if (write(h->dataFd, cmd, len) != (ssize_t)len)
+        return false;
+    // with O_APPEND the file position ends right after our own record
+    off = lseek(h->dataFd, 0, SEEK_CUR) - len;
+    return write(h->idxFd, &off, sizeof(off)) == sizeof(off);
+}
+
+long histFileCount(histFile *h)
+{
+    struct stat st;
+    if (h->idxFd == -1 || fstat(h->idxFd, &st) == -1 || st.st_size < HISTFILE_HEADER)
+        return 0;
+    return (st.st_size - HISTFILE_HEADER) / sizeof(uint64_t);
+}
+
+const char *histFileGet(histFile *h, long n)
+{
+    size_t at = HISTFILE_HEADER + (n - 1) * sizeof(uint64_t);
+    uint64_t off;
+
+    if (n < 1)
+        return NULL;
+    if (at + sizeof(uint64_t) > h->idxLen && !(remap(h->idxFd, &h->idx, &h->idxLen) &&
+                                              at + sizeof(uint64_t) <= h->idxLen))
+        return NULL;
+    if (memcmp(h->idx, HISTFILE_MAGIC, 8) != 0)
+        return NULL;
+    memcpy(&off, h->idx + at, sizeof(off));
+
+    if (off >= h->dataLen && !(remap(h->dataFd, &h->data, &h->dataLen) && off < h->dataLen))
+        return NULL;
+    if (!memchr(h->data + off, '\0', h->dataLen - off))
+        return NULL;
+    return h->data + off;
+}
+
+long histFileCompact(const char *path, long keep, bool dedup)
+{
+    histFile *h = histFileOpen(path);
+    char *tmpData = NULL, *tmpIdx = NULL;
+    long count, first, kept = 0;
+    const char *prev = NULL;
+    FILE *data = NULL, *idx = NULL;
+    char header[HISTFILE_HEADER] = HISTFILE_MAGIC;
+    uint64_t off = 0;
+
+    if (!h)
+        return -1;
+    count = histFileCount(h);
+    first = (keep > 0 && keep < count) ? count - keep + 1 : 1;
+    if (asprintf(&tmpData, "%s.compact", h->path) == -1 ||
+        asprintf(&tmpIdx, "%s.compact", h->idxPath) == -1)
+        goto fail;
+    data = fopen(tmpData, "w");
+    idx = fopen(tmpIdx, "w");
+    if (!data || !idx)
+        goto fail;
+
+    header[8] = HISTFILE_VERSION;
+    fwrite(header, 1, sizeof(header), idx);
+    for (long n = first; n <= count; n++) {
+        const char *cmd = histFileGet(h, n);
+        if (!cmd || (dedup && prev && strcmp(prev, cmd) == 0))
+            continue;
+        size_t len = strlen(cmd) + 1;
+        fwrite(cmd, 1, len, data);
+        fwrite(&off, sizeof(off), 1, idx);
+        off += len;
+        kept++;
+        prev = cmd;   // no remap happens while n only moves forward within count
+    }
+    if (fclose(data) != 0 || fclose(idx) != 0) {
+        data = idx = NULL;
+        goto fail;
+    }
+    data = idx = NULL;
+    chmod(tmpData, 0600);
+    chmod(tmpIdx, 0600);
+
+    // data first: shells notice the new index and reopen both
+    if (rename(tmpData, h->path) == -1 || rename(tmpIdx, h->idxPath) == -1)
+        goto fail;
+    free(tmpData);
+    free(tmpIdx);
+    histFileClose(h);
+    return kept;
+
+fail:
+    perror("compact");
+    if (data)
+        fclose(data);
+    if (idx)
+        fclose(idx);
+    if (tmpData)
+        unlink(tmpData);
+    if (tmpIdx)
+        unlink(tmpIdx);
+    free(tmpData);
+    free(tmpIdx);
+    histFileClose(h);
+    return -1;
+}
@@ -0,0 +1,51 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* On-disk history shared by concurrent shells, read through mmap */
+/* */
+/* <path>      data: NUL-terminated commands, appended with O_APPEND */
+/* <path>.idx  index: a 16 byte header ("MSHHIST1", version, reserved) */
+/*             followed by one little-endian uint64 data offset per entry */
+/* */
+/* Appends write the record first and its index entry second, each with */
+/* a single O_APPEND write, so no lock is needed and an indexed record is */
+/* always complete. Nothing is read at open: lookups map what they touch */
+
+#define HISTFILE_MAGIC "MSHHIST1"
+#define HISTFILE_VERSION 1
+#define HISTFILE_HEADER 16
+
+typedef struct histFile
+{
+    char *path;
+    char *idxPath;
+    int dataFd;
+    int idxFd;
+    ino_t idxIno;		/* to notice the index being replaced by a compaction */
+    const char *data;		/* mapping of the data file, may lag behind its size */
+    size_t dataLen;
+    const char *idx;		/* mapping of the index file, header included */
+    size_t idxLen;
+} histFile;
+
+/* Opens (creating if needed) the history at path */
+/* Returns NULL and prints why on failure */
+histFile *histFileOpen(const char *path);
+void histFileClose(histFile *h);
+
+/* Appends cmd, returns false on a write error */
+bool histFileAppend(histFile *h, const char *cmd);
+
+/* Number of entries, including ones appended by other shells */
+long histFileCount(histFile *h);
+
+/* Returns the nth (1-based) entry or NULL. The pointer is into the */
+/* mapping and stays valid until the next call into this module */
+const char *histFileGet(histFile *h, long n);
+
+/* Rewrites the history at path keeping the last keep entries (all if */
+/* keep <= 0), dropping an entry equal to the one before it if dedup is set */
+/* Returns the number of entries kept, or -1 on error */
+long histFileCompact(const char *path, long keep, bool dedup);
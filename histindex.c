@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "histindex.h"
+
+#define TRIE_DEPTH 16		/* deeper prefixes are verified against a posting list */
+
+typedef struct postings {
+    long *ids;			/* ascending entry numbers */
+    int n;
+    int cap;
+} postings;
+
+typedef struct trieNode {
+    int child;			/* first child, -1 if none */
+    int sibling;		/* next child of the same parent, -1 if none */
+    int deep;			/* postings of entries longer than the trie, -1 if none */
+    long latest;		/* latest entry with this prefix */
+    unsigned char c;
+} trieNode;
+
+typedef struct gramSlot {
+    uint32_t key;		/* 3 bytes of trigram + 1, 0 = empty */
+    postings list;
+} gramSlot;
+
+struct histIndex {
+    histGetter get;
+    void *ctx;
+    long last;
+    trieNode *nodes;
+    int nodeCount, nodeCap;
+    postings *deep;
+    int deepCount, deepCap;
+    gramSlot *grams;
+    int gramCount, gramCap;	/* gramCap is a power of two */
+};
+
+static int push(postings *p, long id)
+{
+    if (p->n && p->ids[p->n - 1] == id)
+        return 1;		/* trigram seen twice in one entry */
+    if (p->n == p->cap) {
+        int cap = p->cap ? p->cap * 2 : 4;
+        long *ids = realloc(p->ids, cap * sizeof(long));
+        if (!ids)
+            return 0;
+        p->ids = ids;
+        p->cap = cap;
+    }
+    p->ids[p->n++] = id;
+    return 1;
+}
+
+static int newNode(histIndex *ix, unsigned char c)
+{
+    if (ix->nodeCount == ix->nodeCap) {
+        int cap = ix->nodeCap ? ix->nodeCap * 2 : 256;
+        trieNode *nodes = realloc(ix->nodes, cap * sizeof(trieNode));
+        if (!nodes)
+            return -1;
+        ix->nodes = nodes;
+        ix->nodeCap = cap;
+    }
+    trieNode *t = &ix->nodes[ix->nodeCount];
+    t->child = t->sibling = t->deep = -1;
+    t->latest = 0;
+    t->c = c;
+    return ix->nodeCount++;
+}
+
+histIndex *histIndexCreate(histGetter get, void *ctx)
+{
+    histIndex *ix = calloc(1, sizeof(histIndex));
+    if (!ix)
+        return NULL;
+    ix->get = get;
+    ix->ctx = ctx;
+    if (newNode(ix, 0) == -1) {
+        free(ix);
+        return NULL;
+    }
+    return ix;
+}
+
+void histIndexClear(histIndex *ix)
+{
+    for (int i = 0; i < ix->deepCount; i++)
+        free(ix->deep[i].ids);
+    for (int i = 0; i < ix->gramCap; i++)
+        free(ix->grams[i].list.ids);
+    free(ix->deep);
+    free(ix->grams);
+    ix->deep = NULL;
+    ix->grams = NULL;
+    ix->deepCount = ix->deepCap = ix->gramCount = ix->gramCap = 0;
+    ix->nodeCount = 0;
+    newNode(ix, 0);
+    ix->last = 0;
+}
+
+void histIndexFree(histIndex *ix)
+{
+    if (!ix)
+        return;
+    histIndexClear(ix);
+    free(ix->nodes);
+    free(ix);
+}
+
+long histIndexLast(const histIndex *ix)
+{
+    return ix->last;
+}
+
+static uint32_t gramKey(const char *s)
+{
+    return ((uint32_t)(unsigned char)s[0] << 16 | (uint32_t)(unsigned char)s[1] << 8 |
+            (unsigned char)s[2]) + 1;
+}
+
+static gramSlot *findGram(const histIndex *ix, uint32_t key)
+{
+    if (!ix->gramCap)
+        return NULL;
+    for (uint32_t i = (key * 2654435761u) & (ix->gramCap - 1); ; i = (i + 1) & (ix->gramCap - 1)) {
+        gramSlot *g = &ix->grams[i];
+        if (g->key == key || g->key == 0)
+            return g;
+    }
+}
+
+static gramSlot *addGram(histIndex *ix, uint32_t key)
+{
+    if ((ix->gramCount + 1) * 2 > ix->gramCap) {
+        int cap = ix->gramCap ? ix->gramCap * 2 : 1024;
+        gramSlot *old = ix->grams;
+        int oldCap = ix->gramCap;
+        ix->grams = calloc(cap, sizeof(gramSlot));
+        if (!ix->grams) {
+            ix->grams = old;
+            return NULL;
+        }
+        ix->gramCap = cap;
+        for (int i = 0; i < oldCap; i++)
+            if (old[i].key)
+                *findGram(ix, old[i].key) = old[i];
+        free(old);
+    }
+    gramSlot *g = findGram(ix, key);
+    if (!g->key) {
+        g->key = key;
+        ix->gramCount++;
+    }
+    return g;
+}
+
+void histIndexAdd(histIndex *ix, long n, const char *cmd)
+{
+    int node = 0;
+    size_t len = strlen(cmd);
+
+    ix->last = n;
+    ix->nodes[0].latest = n;
+    for (size_t i = 0; i < len && i < TRIE_DEPTH; i++) {
+        unsigned char c = cmd[i];
+        int child = ix->nodes[node].child;
+        while (child != -1 && ix->nodes[child].c != c)
+            child = ix->nodes[child].sibling;
+        if (child == -1) {
+            if ((child = newNode(ix, c)) == -1)
+                return;
+            ix->nodes[child].sibling = ix->nodes[node].child;
+            ix->nodes[node].child = child;
+        }
+        node = child;
+        ix->nodes[node].latest = n;
+    }
+    if (len > TRIE_DEPTH) {
+        if (ix->nodes[node].deep == -1) {
+            if (ix->deepCount == ix->deepCap) {
+                int cap = ix->deepCap ? ix->deepCap * 2 : 64;
+                postings *deep = realloc(ix->deep, cap * sizeof(postings));
+                if (!deep)
+                    return;
+                ix->deep = deep;
+                ix->deepCap = cap;
+            }
+            memset(&ix->deep[ix->deepCount], 0, sizeof(postings));
+            ix->nodes[node].deep = ix->deepCount++;
+        }
+        push(&ix->deep[ix->nodes[node].deep], n);
+    }
+
+    for (size_t i = 0; i + 3 <= len; i++) {
+        gramSlot *g = addGram(ix, gramKey(cmd + i));
+        if (g)
+            push(&g->list, n);
+    }
+}
+
+long histIndexPrefix(histIndex *ix, const char *prefix)
+{
+    size_t len = strlen(prefix);
+    int node = 0;
+
+    for (size_t i = 0; i < len && i < TRIE_DEPTH; i++) {
+        int child = ix->nodes[node].child;
+        while (child != -1 && ix->nodes[child].c != (unsigned char)prefix[i])
+            child = ix->nodes[child].sibling;
+        if (child == -1)
+            return 0;
+        node = child;
+    }
+    if (len <= TRIE_DEPTH)
+        return ix->get(ix->ctx, ix->nodes[node].latest) ? ix->nodes[node].latest : 0;
+
+    // past the trie: newest candidates first until one matches
+    if (ix->nodes[node].deep == -1)
+        return 0;
+    postings *p = &ix->deep[ix->nodes[node].deep];
+    for (int i = p->n - 1; i >= 0; i--) {
+        const char *cmd = ix->get(ix->ctx, p->ids[i]);
+        if (!cmd)
+            return 0;		/* older ones are gone too */
+        if (strncmp(cmd, prefix, len) == 0)
+            return p->ids[i];
+    }
+    return 0;
+}
+
+/* Moves *cursor to the first id >= id, returns whether that id is there */
+static int advanceTo(const postings *p, int *cursor, long id)
+{
+    int i = *cursor;
+    int step = 1;
+    /* gallop, then binary search the last step */
+    while (i + step < p->n && p->ids[i + step] < id) {
+        i += step;
+        step *= 2;
+    }
+    int lo = i, hi = i + step < p->n ? i + step : p->n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (p->ids[mid] < id)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *cursor = lo;
+    return lo < p->n && p->ids[lo] == id;
+}
+
+static int bySize(const void *a, const void *b)
+{
+    return (*(const postings * const *)a)->n - (*(const postings * const *)b)->n;
+}
+
+long histIndexSearch(histIndex *ix, const char *pattern, long from, long to,
+                     void (*found)(long n, const char *cmd, void *arg), void *arg)
+{
+    size_t len = strlen(pattern);
+    long matches = 0;
+
+    if (len < 3) {
+        // too short for a trigram: check every entry
+        for (long n = from; n <= to; n++) {
+            const char *cmd = ix->get(ix->ctx, n);
+            if (cmd && strstr(cmd, pattern)) {
+                found(n, cmd, arg);
+                matches++;
+            }
+        }
+        return matches;
+    }
+
+    // walk the rarest trigram's list, keep ids every other list contains;
+    // all lists are ascending, so each cursor only ever moves forward
+    int ngrams = len - 2;
+    const postings **lists = malloc(ngrams * sizeof(postings *));
+    int *cursors = calloc(ngrams, sizeof(int));
+    if (!lists || !cursors) {
+        free(lists);
+        free(cursors);
+        return 0;
+    }
+    for (int i = 0; i < ngrams; i++) {
+        gramSlot *g = findGram(ix, gramKey(pattern + i));
+        if (!g || !g->key) {
+            free(lists);
+            free(cursors);
+            return 0;
+        }
+        lists[i] = &g->list;
+    }
+    qsort(lists, ngrams, sizeof(postings *), bySize);
+
+    for (int i = 0; i < lists[0]->n; i++) {
+        long n = lists[0]->ids[i];
+        if (n < from || n > to)
+            continue;
+        int j = 1;
+        while (j < ngrams && advanceTo(lists[j], &cursors[j], n))
+            j++;
+        if (j < ngrams)
+            continue;
+        const char *cmd = ix->get(ix->ctx, n);
+        if (cmd && strstr(cmd, pattern)) {
+            found(n, cmd, arg);
+            matches++;
+        }
+    }
+    free(lists);
+    free(cursors);
+    return matches;
+}
@@ -0,0 +1,31 @@
+#include <stdbool.h>
+
+/* Incremental search index over history entries numbered 1, 2, 3... */
+/* A depth-limited prefix trie answers "latest entry starting with" and a */
+/* trigram index narrows substring searches to a few candidates. Entries */
+/* are read back through the getter to verify matches; numbers it no */
+/* longer knows (NULL) are treated as evicted */
+
+typedef const char *(*histGetter)(void *ctx, long n);
+
+typedef struct histIndex histIndex;
+
+histIndex *histIndexCreate(histGetter get, void *ctx);
+void histIndexFree(histIndex *ix);
+
+/* Indexes entry n. Entries must be added in increasing order */
+void histIndexAdd(histIndex *ix, long n, const char *cmd);
+
+/* Number of the last entry added, 0 if none */
+long histIndexLast(const histIndex *ix);
+
+/* Drops everything, e.g. after the numbering changed underneath */
+void histIndexClear(histIndex *ix);
+
+/* Returns the latest entry number starting with prefix, or 0 */
+long histIndexPrefix(histIndex *ix, const char *prefix);
+
+/* Calls found for every entry in [from, to] containing pattern, in order */
+/* Returns the number of matches */
+long histIndexSearch(histIndex *ix, const char *pattern, long from, long to,
+                     void (*found)(long n, const char *cmd, void *arg), void *arg);
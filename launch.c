@@ -0,0 +1,178 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include "launch.h"
+#include "zygote.h"
+
+extern char **environ;
+
+static launchBackend backend = LAUNCH_SPAWN;
+static sigset_t childMask;
+static sigset_t childDefaults;     // empty unless job control ignores some
+static bool verbose;
+
+void initLaunch(launchBackend b, const sigset_t *mask, bool v)
+{
+    backend = b;
+    if (mask)
+        childMask = *mask;
+    else
+        sigprocmask(SIG_SETMASK, NULL, &childMask);
+    verbose = v;
+}
+
+void initLaunchSignals(const sigset_t *defaults)
+{
+    childDefaults = *defaults;
+}
+
+int parseLaunchBackend(const char *str)
+{
+    if (strcmp(str, "fork") == 0)
+        return LAUNCH_FORK;
+    if (strcmp(str, "spawn") == 0)
+        return LAUNCH_SPAWN;
+    if (strcmp(str, "zygote") == 0)
+        return LAUNCH_ZYGOTE;
+    return -1;
+}
+
+const char *launchBackendName(launchBackend b)
+{
+    return b == LAUNCH_FORK ? "fork" : b == LAUNCH_SPAWN ? "spawn" : "zygote";
+}
+
+// Applied by the child to itself, after the fds are wired up.
+static int applySched(const launchSched *s)
+{
+    if (s->pin && sched_setaffinity(0, sizeof(s->cpus), &s->cpus) == -1)
+        return -1;
+    errno = 0;
+    if (s->renice && nice(s->niceAdjust) == -1 && errno)
+        return -1;
+    if (s->setPolicy) {
+        struct sched_param param = { .sched_priority = s->priority };
+        if (sched_setscheduler(0, s->policy, &param) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+// Classic path: the child rewires its own fds, then execs.
+static pid_t forkLaunch(const launchSpec *spec)
+{
+    pid_t pid = fork();
+    if (pid != 0)
+        return pid;
+
+    // child
+    if (spec->pgid)
+        setpgid(0, spec->pgid == LAUNCH_NEW_PGROUP ? 0 : spec->pgid);
+    for (int sig = 1; sig < NSIG; sig++)
+        if (sigismember(&childDefaults, sig) == 1)
+            signal(sig, SIG_DFL);
+    sigprocmask(SIG_SETMASK, &childMask, NULL);
+    if (spec->in_fd != -1) {
+        dup2(spec->in_fd, STDIN_FILENO);
+        if (spec->in_fd != STDIN_FILENO)
+            close(spec->in_fd);
+    }
+    else if (spec->inputRedirect) {
+        close(STDIN_FILENO);
+        if (open(spec->inputRedirect, O_RDONLY) == -1 && verbose)
+            perror("Input redirection open failed");
+    }
+    if (spec->out_fd != -1) {
+        dup2(spec->out_fd, STDOUT_FILENO);
+        if (spec->out_fd != STDOUT_FILENO)
+            close(spec->out_fd);
+    }
+    else if (spec->outputRedirect) {
+        close(STDOUT_FILENO);
+        if (open(spec->outputRedirect, O_WRONLY | O_CREAT | O_TRUNC, 0644) == -1 && verbose)
+            perror("output redirection open failed");
+    }
+    if (spec->sched && applySched(spec->sched) == -1) {
+        if (verbose)
+            perror("scheduling failed");
+        _exit(126);
+    }
+    execvp(spec->path, spec->argv);
+    if (verbose)
+        perror("exec failed");
+    _exit(127);
+}
+
+// posix_spawn path: fd wiring is expressed as file actions and glibc
+// runs them in a CLONE_VM|CLONE_VFORK child, so nothing is copied.
+static pid_t spawnLaunch(const launchSpec *spec)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    pid_t pid;
+    int err;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    if (spec->in_fd != -1)
+        posix_spawn_file_actions_adddup2(&actions, spec->in_fd, STDIN_FILENO);
+    else if (spec->inputRedirect)
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, spec->inputRedirect, O_RDONLY, 0);
+    if (spec->out_fd != -1)
+        posix_spawn_file_actions_adddup2(&actions, spec->out_fd, STDOUT_FILENO);
+    else if (spec->outputRedirect)
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, spec->outputRedirect,
+                                         O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    posix_spawnattr_setsigmask(&attr, &childMask);
+    posix_spawnattr_setsigdefault(&attr, &childDefaults);
+    if (spec->pgid) {
+        posix_spawnattr_setpgroup(&attr, spec->pgid == LAUNCH_NEW_PGROUP ? 0 : spec->pgid);
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    err = posix_spawnp(&pid, spec->path, &actions, &attr, spec->argv, environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+pid_t launchWith(launchBackend b, const launchSpec *spec)
+{
+    if (spec->sched)
+        b = LAUNCH_FORK;
+    pid_t pid = -1;
+    if (b == LAUNCH_ZYGOTE && zygoteRunning()) {
+        pid = zygoteLaunch(spec, &childMask, &childDefaults);
+        // helper gone or request too big for it: spawn directly
+        if (pid == -1 && (errno == E2BIG || !zygoteRunning()))
+            b = LAUNCH_SPAWN;
+    }
+    else if (b == LAUNCH_ZYGOTE)
+        b = LAUNCH_SPAWN;
+    if (b != LAUNCH_ZYGOTE)
+        pid = b == LAUNCH_FORK ? forkLaunch(spec) : spawnLaunch(spec);
+    // the parent sets the group too, so it holds whichever side runs first
+    if (pid > 0 && spec->pgid)
+        setpgid(pid, spec->pgid == LAUNCH_NEW_PGROUP ? pid : spec->pgid);
+    return pid;
+}
+
+pid_t launchProcess(const launchSpec *spec)
+{
+    return launchWith(backend, spec);
+}
@@ -0,0 +1,57 @@
+#include <stdbool.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/types.h>
+
+typedef enum {
+    LAUNCH_FORK,    /* fork() then exec in the child */
+    LAUNCH_SPAWN,   /* posix_spawn: vfork-style, no page table copy */
+    LAUNCH_ZYGOTE   /* request to a small helper forked at startup, see zygote.h */
+} launchBackend;
+
+#define LAUNCH_NEW_PGROUP (-1)   /* pgid: the child leads a new process group */
+
+/* Scheduling the child applies to itself before exec (pin/nice/sched prefixes) */
+typedef struct launchSched
+{
+    bool pin;                        /* restrict the child to cpus */
+    cpu_set_t cpus;
+    bool renice;                     /* add niceAdjust to the inherited nice value */
+    int niceAdjust;
+    bool setPolicy;                  /* switch to policy at priority */
+    int policy;                      /* SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO, SCHED_RR */
+    int priority;
+} launchSched;
+
+typedef struct launchSpec
+{
+    const char *path;                /* program to run, looked up in PATH if it has no '/' */
+    char *const *argv;               /* NULL-terminated argument vector */
+    int in_fd;                       /* fd to become stdin, -1 to leave stdin alone */
+    int out_fd;                      /* fd to become stdout, -1 to leave stdout alone */
+    const char *inputRedirect;       /* file opened as stdin when in_fd is -1. May be NULL */
+    const char *outputRedirect;      /* file truncated as stdout when out_fd is -1. May be NULL */
+    pid_t pgid;                      /* process group to join, LAUNCH_NEW_PGROUP, or 0 to stay in the shell's */
+    const launchSched *sched;        /* NULL to inherit the shell's affinity, nice and policy */
+} launchSpec;
+
+/* Selects the backend and the signal mask children get before exec */
+/* verbose makes failing children report why they could not exec */
+void initLaunch(launchBackend backend, const sigset_t *childMask, bool verbose);
+
+/* Signals the shell ignores for itself (job control) that children */
+/* must get back at their default disposition before exec */
+void initLaunchSignals(const sigset_t *defaults);
+
+/* Returns the backend named by str ("fork", "spawn" or "zygote"), or -1 */
+int parseLaunchBackend(const char *str);
+const char *launchBackendName(launchBackend backend);
+
+/* Starts spec->path with the selected backend */
+/* Returns the child's pid, or -1 with errno set if it could not be started */
+pid_t launchProcess(const launchSpec *spec);
+
+/* Same as launchProcess, with an explicit backend */
+/* posix_spawn has no affinity or nice attribute, and glibc accepts but */
+/* ignores POSIX_SPAWN_SETSCHEDULER: a spec with sched takes the fork path */
+pid_t launchWith(launchBackend backend, const launchSpec *spec);
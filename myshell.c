@@ -1,650 +1,2974 @@
-#define _XOPEN_SOURCE 600 // used to include WCONTINUED used for waitpid
-#include <stdio.h>
-#include <unistd.h>
-#include <linux/limits.h>
-#include <string.h>
-#include <stdlib.h>
-#include <stdbool.h>
-#include <sys/wait.h>
-#include <signal.h>
-#include <time.h>
-#include <fcntl.h>
-#include <sys/types.h>
-#include <errno.h>
-#include <ctype.h>
-
-#include "LineParser.h"
-
-#define TERMINATED  -1
-#define RUNNING 1
-#define SUSPENDED 0
-#define HISTLEN 20
-
-typedef enum {
-    CMD_QUIT,
-    CMD_CD,
-    CMD_HALT,
-    CMD_WAKEUP,
-    CMD_ICE,
-    CMD_PROCS,
-    CMD_EXECUTE
-} Command;
-
-typedef struct process{
-        cmdLine* cmd;
-        pid_t pid;
-        int status; 
-        struct process *next;
-} process;
-
-typedef struct history_entry {
-    char *cmd;
-    struct history_entry *next;
-} history_entry;
-
-typedef struct {
-    history_entry *head;
-    history_entry *tail;
-    int count;
-} history_list;
-
-bool debug;
-process *process_list = NULL;
-
-// USer Commands
-void sigCommand(const char *pidStr, int sig);
-void cdCommand(const char *path, char *cwd);
-
-// Executers
-void dispatchCommand(cmdLine *pCmdLine, char cwd[]);
-void execute(cmdLine *pCmdLine);
-int forkAndExec(char *path, char *const argv[], int in_fd, int out_fd);
-
-// Process
-void addProcess(process** process_list, cmdLine* cmd, pid_t pid);
-void printProcessList(process** process_list);
-void freeProcessList(process **plist);
-void updateProcessList(process **plist);
-void updateProcessStatus(process *process_list, int pid, int status);
-void removeTerminatedProcesses(process **plist);
-
-// History
-void initHistory(history_list *h);
-void freeHistory(history_list *h);
-void addHistory(history_list *h, const char *cmd);
-void printHistory(const history_list *h);
-const char *getHistory(const history_list *h, int n);
-const char *getLastHistory(const history_list *h);
-bool expandHistoryLine(history_list *history, char *input);
-
-// Helpers 
-void runPipeline(cmdLine *left);
-bool shouldDebug(int agrc, char **argv);
-Command getCommand(const char *cmd);
-void handleRedirect(cmdLine *pCmdLine);
-void DebugMessage(char *message, bool sysError);
-bool validateNoRedirectConflict(cmdLine *left, cmdLine *right);
-void DebugChild(int pid, char *cmd);
-
-
-int main(int argc, char **argv) {
-    debug = shouldDebug(argc, argv);
-    char cwd[PATH_MAX];
-    char input[2048];
-    bool quit = false;
-    getcwd(cwd, PATH_MAX);
-    history_list history;
-    initHistory(&history);
-    while (!quit) {
-
-        printf("%s: ", cwd);
-        fflush(stdout); 
-         if(fgets(input, sizeof(input), stdin) == NULL) {
-            putchar('\n');
-            break;  //EOF signal
-        }
-
-        // Strip new line
-        input[strcspn(input, "\n")] = '\0';
-        if (input[0] == '\0')
-            continue;
-
-         // history handling- expand every !n or !! anywhere in the line
-        if (expandHistoryLine(&history, input))
-            continue;    // handled hist or error
-
-        // record in history
-        addHistory(&history, input);
-
-        cmdLine *pCmdLine = parseCmdLines(input);
-        if (!pCmdLine) {
-            continue;  // Skip to next iteration if parsing failed or empty
-        }
-
-        // handle quit 
-        if (getCommand(pCmdLine->arguments[0]) == CMD_QUIT) {
-            freeCmdLines(pCmdLine);
-            quit = true;
-            break;
-        }
-
-        dispatchCommand(pCmdLine, cwd);
-    }
-
-    // Cleanup
-    freeProcessList(&process_list);
-    freeHistory(&history);
-    return 0;
-}
-
-// Handle exactly two commands joined by a pipe
-void runPipeline(cmdLine *pCmdLine) {
-    cmdLine *left  = pCmdLine;
-    cmdLine *right = pCmdLine->next;
-
-    // Detach into two one‐node lists
-    left->next  = NULL;
-    right->next = NULL;
-
-    if (!validateNoRedirectConflict(left, right))
-        return;
-
-    int pipefd[2];
-    if (pipe(pipefd) == -1) {
-        DebugMessage("pipe", true);
-        return;
-    }
-
-    // left: stdout -> pipefd[1]
-    int p1 = forkAndExec(
-        left->arguments[0],
-        left->arguments,
-        left->inputRedirect  ? open(left->inputRedirect,  O_RDONLY) : -1,
-        pipefd[1]
-    );
-    addProcess(&process_list, left, p1);
-    DebugChild(p1, left->arguments[0]);
-
-    close(pipefd[1]);
-    // right: stdin <- pipefd[0]
-    int p2 = forkAndExec(
-        right->arguments[0],
-        right->arguments,
-        pipefd[0],
-        right->outputRedirect ? open(right->outputRedirect, O_CREAT|O_WRONLY | O_TRUNC, 0666) : -1
-    );
-    addProcess(&process_list, right, p2);
-    DebugChild(p2, right->arguments[0]);
-
-    // parent closes both ends
-    close(pipefd[0]);
-
-    // wait for both
-    if (left->blocking) {
-        waitpid(p1, NULL, 0);
-        waitpid(p2, NULL, 0);
-    }
-}
-
-// Iterates through user arguments, returns true if the prgoram should
-// Print debugging information.
-bool shouldDebug(int argc, char **argv) {
-    for (int i = 0; i < argc; i++) {
-        if(strcmp(argv[i], "-d") == 0)
-            return true;
-    }
-    return false;
-}
-
-/// Dispatch a parsed command line 
-void dispatchCommand(cmdLine *pCmdLine, char cwd[]) {
-    bool shouldFree = true;
-
-    if (pCmdLine->next) {
-        runPipeline(pCmdLine);
-        shouldFree = false;
-    }
-    else {
-        Command cmd = getCommand(pCmdLine->arguments[0]);
-        switch (cmd) {
-            case CMD_QUIT: //we'll quit in main
-                break;
-            case CMD_CD:
-                cdCommand(
-                    pCmdLine->argCount>1 ? pCmdLine->arguments[1] : NULL,
-                    cwd
-                );
-                break;
-            case CMD_HALT:
-                sigCommand(
-                    pCmdLine->argCount>1 ? pCmdLine->arguments[1] : NULL,
-                    SIGSTOP
-                );
-                break;
-            case CMD_ICE:
-                sigCommand(
-                    pCmdLine->argCount>1 ? pCmdLine->arguments[1] : NULL,
-                    SIGINT
-                );
-                break;
-            case CMD_WAKEUP:
-                sigCommand(
-                    pCmdLine->argCount>1 ? pCmdLine->arguments[1] : NULL,
-                    SIGCONT
-                );
-                break;
-            case CMD_PROCS:
-                printProcessList(&process_list);
-                break;
-            case CMD_EXECUTE:
-                execute(pCmdLine);
-                shouldFree = false;
-                break;
-            default:
-                break;
-        }
-    }
-
-    nanosleep(&(struct timespec){0, 500000000}, NULL);
-    if (shouldFree)
-        freeCmdLines(pCmdLine);
-}
-
-// executes using the path variables the command with arguemnts given.
-void execute(cmdLine *pCmdLine) {
-    int pid = fork();
-    //Error in fork
-    if (pid < 0) {
-        DebugMessage("fork failed", true);
-        return;
-    }
-    // Child process execute
-    if (pid == 0) {
-        handleRedirect(pCmdLine);
-        if(execvp(pCmdLine->arguments[0], pCmdLine->arguments) == -1) {
-            DebugMessage("execvp failed", true);
-            exit(EXIT_FAILURE);
-        }
-    }
-    // In parent
-    else {
-        addProcess(&process_list, pCmdLine, pid);
-        DebugChild(pid, pCmdLine->arguments[0]);
-        if(pCmdLine->blocking) {
-            waitpid(pid, NULL, 0);
-        }
-    }
-}
-
-// gets a cmd command, and returns the corresponsing enum value
-Command getCommand(const char *cmd) {
-    if (strcmp(cmd, "quit") == 0)
-        return CMD_QUIT;
-    else if (strcmp(cmd, "cd") == 0)
-        return CMD_CD;
-    else if (strcmp(cmd, "halt") == 0)
-        return CMD_HALT;
-    else if (strcmp(cmd, "wakeup") == 0)
-        return CMD_WAKEUP;
-    else if (strcmp(cmd, "ice") == 0)
-        return CMD_ICE;
-    else if (strcmp(cmd, "procs") == 0)
-        return CMD_PROCS;
-    else
-        return CMD_EXECUTE;
-}
-// Changes directory to given path, updates cwd variable.
-void cdCommand(const char* path, char *cwd) {
-    if (path == NULL) {
-        if(debug) {
-            DebugMessage("cd: missing operand", false);
-        }
-        return;
-    }
-    if (chdir(path) != 0) {
-        if (debug) {
-            DebugMessage("chdir failed", true);
-        }
-    }
-    else {
-        getcwd(cwd, PATH_MAX);
-    }
-}
-
-//sigCommand - Sends the specified signal to the process whose PID is provided by pidStr.
-void sigCommand(const char *pidStr, int sig) {
-    if(pidStr == NULL) {
-        DebugMessage("PID not provided", false);
-        return;
-    }
-    int pid = atoi(pidStr);
-    if (kill(pid, sig) == -1) {
-        DebugMessage("signal failed", true);
-    }
-    else {
-        if (sig == SIGSTOP) {
-            updateProcessStatus(process_list, pid, SUSPENDED);
-            DebugMessage("signaled STOP", false);
-        }
-        else if (sig == SIGCONT) {
-            updateProcessStatus(process_list, pid, RUNNING);
-            DebugMessage("signaled SIGCONT", false);
-        }
-        else if (sig == SIGINT) {
-            updateProcessStatus(process_list, pid, TERMINATED);
-            DebugMessage("signaled SIGINT", false);
-        }
-    }
-}
-
-
-// ——— Process —————————————————————————————————————————————
-void addProcess(process** plist, cmdLine* cmd, pid_t pid) {
-    process *p = malloc(sizeof(process));
-    if (!p) { perror("malloc"); return; }
-    p->cmd = cmd;
-    p->pid = pid;
-    p->status = RUNNING;
-    p->next = *plist;
-    *plist = p;
-}
-
-// Update statuses by non-blocking waitpid() 
-void updateProcessList(process **plist) {
-    for (process *p = *plist; p; p = p->next) {
-        int st;
-        // Add WCONTINUED so SIGCONT will show up as a state change
-        pid_t r = waitpid(p->pid, &st, WNOHANG | WUNTRACED | WCONTINUED);
-        if (r > 0) {
-            if (WIFEXITED(st) || WIFSIGNALED(st))
-                p->status = TERMINATED;
-            else if (WIFSTOPPED(st))
-                p->status = SUSPENDED;
-            else
-                p->status = RUNNING;
-        }
-        else if (r == -1 && errno == ECHILD) {
-            p->status = TERMINATED;
-        }
-    }
-}
-
-/**
- * Find the process with the given pid in process_list
- * and set its status field to the new value.
- */
-void updateProcessStatus(process *process_list, int pid, int status) {
-    for (process *p = process_list; p; p = p->next) {
-        if (p->pid == pid) {
-            p->status = status;
-            return;
-        }
-    }
-}
-
-// Prints process List PID Command STATUS
-void printProcessList(process** plist) {
-    updateProcessList(plist);
-
-    // Header 
-    printf("PID          Command      STATUS\n");
-    // Entries
-    for (process *p = *plist; p; p = p->next) {
-        const char *statusStr = 
-            (p->status == RUNNING)   ? "Running"    :
-            (p->status == SUSPENDED) ? "Suspended"  :
-                                       "Terminated";
-
-        // Print PID left-aligned in width 12, command in width 12, then status
-        printf("%-12d%-12s%s\n",
-               p->pid,
-               p->cmd->arguments[0],
-               statusStr);
-    }
-
-    // Clean up the terminated processes
-    removeTerminatedProcesses(plist);
-}
-
-void removeTerminatedProcesses(process **plist) {
-    process *prev = NULL;
-    process *cur  = *plist;
-    while (cur) {
-        if (cur->status == TERMINATED) {
-            process *toDel = cur;
-            // unlink it
-            if (prev)
-                prev->next = cur->next;
-            else
-                *plist = cur->next;
-            cur = cur->next;           // advance before freeing
-            freeCmdLines(toDel->cmd);
-            free(toDel);
-        }
-        else {
-            prev = cur;
-            cur  = cur->next;
-        }
-    }
-}
-
-// Free the list on shell exit
-void freeProcessList(process **plist) {
-    process *p = *plist;
-    while (p) {
-        process *next = p->next;
-        freeCmdLines(p->cmd);   // if you own that memory
-        free(p);
-        p = next;
-    }
-    *plist = NULL;
-}
-
-// ——— History —————————————————————————————————————————————
-
-// initialize to empty
-void initHistory(history_list *h) {
-    h->head = NULL;
-    h->tail = NULL;
-    h->count = 0;
-}
-
-// free all nodes & strings
-void freeHistory(history_list *h) {
-    history_entry *curr = h->head;
-    while (curr) {
-        history_entry *next = curr->next;
-        free(curr->cmd);
-        free(curr);
-        curr = next;
-    }
-    initHistory(h);
-}
-
-// add a new command, removing the oldest if full
-void addHistory(history_list *h, const char *cmd) {
-    char *copy = strdup(cmd);
-    history_entry *entry = malloc(sizeof(history_entry));
-    entry->cmd  = copy;
-    entry->next = NULL;
-
-    if (h->count == 0) {
-        h->head = entry;
-        h->tail = entry;
-        h->count = 1;
-    }
-    else {
-        h->tail->next = entry;
-        h->tail = entry;
-        if (h->count < HISTLEN) {
-            h->count++;
-        } else {
-            // remove oldest
-            history_entry *old = h->head;
-            h->head = old->next;
-            free(old->cmd);
-            free(old);
-        }
-    }
-}
-
-// print numbered history
-void printHistory(const history_list *h) {
-    history_entry *e = h->head;
-    // Stops at null entry
-    for (int i = 1; e; e = e->next, i++) {
-        printf("%2d  %s\n", i, e->cmd);
-    }
-}
-
-// get the nth (1-based) entry, or NULL
-const char *getHistory(const history_list *h, int n) {
-    if (n < 1 || n > h->count)
-        return NULL;
-    history_entry *e = h->head;
-    for (int i = 1; i < n; i++)
-        e = e->next;
-    return e ? e->cmd : NULL;
-}
-
-// get the last (most recent) entry, or NULL
-const char *getLastHistory(const history_list *h) {
-    return h->tail ? h->tail->cmd : NULL;
-}
-
-
-// Returns true if we handled a “hist” command (so caller should continue),
-// or false if input has been rewritten (or left alone) and should be executed.
-bool expandHistoryLine(history_list *history, char *input) {
-    // Handle “hist” as a special case
-    if (strcmp(input, "hist") == 0) {
-        printHistory(history);
-        return true;
-    }
-
-    // Build the expanded line in this buffer
-    char buffer[2048];
-    int  w = 0;        // write index into buffer
-    char *r = input;   // read pointer into input
-
-    // iterate over every char in input
-    while (*r && w < (int)sizeof(buffer) - 1) {
-        //  !!
-        if (r[0]=='!' && r[1]=='!') {
-            const char *h = getLastHistory(history);
-            if (!h) {
-                fprintf(stderr, "No commands in history\n");
-                return true;  // skip execution
-            }
-            // copy the entire h into buffer
-            for (const char *p = h; *p && w < (int)sizeof(buffer)-1; p++)
-                buffer[w++] = *p;
-            r += 2;  // advance past "!!"
-        }
-
-        // !n
-        else if (r[0]=='!' && isdigit((unsigned char)r[1])) {
-            // read the number
-            int n = 0;
-            char *q = r + 1;
-            while (isdigit((unsigned char)*q)) {
-                n = n * 10 + (*q - '0');
-                q++;
-            }
-            const char *h = getHistory(history, n);
-            if (!h) {
-                fprintf(stderr, "No such command: %d\n", n);
-                return true;
-            }
-            // copy that history entry
-            for (const char *p = h; *p && w < (int)sizeof(buffer)-1; p++)
-                buffer[w++] = *p;
-            r = q;  // advance past !n
-        }
-
-        // everything else, just copy one character
-        else {
-            buffer[w++] = *r++;
-        }
-    }
-
-    // NUL-terminate
-    buffer[w] = '\0';
-
-    // If nothing changed, just leave input alone.
-    //    If it did change—or if it contained !! or !n—we overwrite.
-    if (strcmp(buffer, input) != 0) {
-        strcpy(input, buffer);
-        printf("%s\n", input);
-    }
-
-    //  false -> caller should parse and execute the new input
-    return false;
-}
-
-
-// ——— Helpers —————————————————————————————————————————————
-
-void handleRedirect(cmdLine *pCmdLine) {
-    if (pCmdLine->inputRedirect != NULL) {
-        close(0);
-        if (open(pCmdLine->inputRedirect, O_RDONLY) == -1) {
-            if (debug) {
-                DebugMessage("Input redirection open failed", true);
-            }
-        }
-    }
-    if (pCmdLine->outputRedirect!= NULL) {
-        close(1);
-        if (open(pCmdLine->outputRedirect, O_WRONLY | O_CREAT | O_TRUNC, 0644)  == -1) {
-            if (debug) {
-                DebugMessage("output redirection open failed", true);
-            }
-        }
-    }
-}
-
-// Print an error and return false
-bool validateNoRedirectConflict(cmdLine *left, cmdLine *right) {
-    if (left->outputRedirect || right->inputRedirect) {
-        DebugMessage("can't mix pipe and I/O redirect", false);
-        return false;
-    }
-    return true;
-}
-
-// Fork a child that redirects its stdin/out, then execs.
-// If in_fd or out_fd is -1, that side isn’t redirected.
-int forkAndExec(char *path, char *const argv[],
-                         int in_fd, int out_fd)
-{
-    int pid = fork();
-    if (pid == 0) {
-        // child
-        if (in_fd  != -1) { close(STDIN_FILENO);  dup(in_fd); close(in_fd); }
-        if (out_fd != -1) { close(STDOUT_FILENO); dup(out_fd); close(out_fd); }
-        // close any pipe FDs inherited
-        // (we assume parent will close its copies)
-        execvp(path, argv);
-        DebugMessage("exec failed", true);
-        exit(1);
-    }
-    return pid;
-}
-
-void DebugMessage(char *message, bool sysError){
-    if(debug){
-        if (sysError)
-            perror(message);
-        else
-            fprintf(stderr, "%s\n", message);
-    }
-}
-
-void DebugChild(int pid, char *cmd) {
-    char msg[100];
-    snprintf(msg, sizeof(msg), "%s%d", "PID: ", pid);
-    DebugMessage(msg, false);
-    snprintf(msg, sizeof(msg), "%s%s", "Command: ", cmd);
-    DebugMessage(msg, false);
+#define _GNU_SOURCE // WCONTINUED for waitpid, pipe2
+#include <stdio.h>
+#include <unistd.h>
+#include <linux/limits.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/sendfile.h>
+#include <termios.h>
+
+#include "myshell.h"
+
+bool debug;
+process_table process_list = {0};
+int sigchld_fd = -1;         // signalfd delivering SIGCHLD, polled with stdin
+sigset_t shell_sigmask;      // mask to restore in children before exec
+latency_counter latency = {0};
+feeder *active_feeder = NULL;
+bool job_control;
+pid_t shell_pgid;
+static pid_t original_pgrp;         // terminal owner to give the terminal back to
+static struct termios shell_tmodes;
+static int timed_lines;             // time nesting: keep finished records to report
+shellSettings settings = { .spread = false, .pipebuf = 0 };
+
+#ifndef MYSHELL_NO_MAIN
+int main(int argc, char **argv) {
+    shellOptions opts;
+    if (!parseOptions(argc, argv, &opts))
+        return 2;
+    debug = opts.debug;
+    if (getenv("MYSHELL_TRACE"))
+        traceSetFile(getenv("MYSHELL_TRACE"));
+    // fork the launch helper while the shell is at its smallest
+    if (opts.backend == LAUNCH_ZYGOTE && !zygoteStart())
+        DebugMessage("zygote", true);
+    char cwd[PATH_MAX];
+    inputSource in;
+    char *input;
+    bool quit = false;
+    long started = 0;
+    int status = 0;
+    long commands = 0, failures = 0;
+    long began = nowNanos();
+    if (!openInput(&in, &opts))
+        return 127;
+    // Scripts, -c and piped input skip the prompt entirely
+    bool interactive = in.fd == STDIN_FILENO && isatty(STDIN_FILENO);
+    getcwd(cwd, PATH_MAX);
+    history_list history;
+    if (!initHistory(&history, opts.histSize, opts.histFile))
+        return 1;
+    initSignals();
+    initLaunch(opts.backend, &shell_sigmask, debug);
+    if (interactive)
+        initJobControl();
+    while (!quit) {
+        if (started) {
+            recordLatency(&latency, nowNanos() - started);
+            started = 0;
+        }
+
+        if (interactive) {
+            printf("%s: ", cwd);
+            fflush(stdout); 
+        }
+        if ((input = readInputLine(&in)) == NULL) {
+            if (interactive)
+                putchar('\n');
+            break;  //EOF signal
+        }
+
+        if (input[0] == '\0')
+            continue;
+
+         // history handling- expand every !n or !! anywhere in the line
+        if (expandHistoryLine(&history, &input))
+            continue;    // handled hist or error
+
+        // record in history
+        addHistory(&history, input);
+
+        started = nowNanos();
+        traceEvent(TRACE_PARSE_START, 0, 0, 0, started);
+        cmdLine *pCmdLine = parseCachedCmdLines(input);
+        long parsed = nowNanos();
+        traceEvent(TRACE_PARSE_END, 0, 0, 0, parsed);
+        traceSample(TRACE_PARSE_TIME, parsed - started);
+        if (!pCmdLine) {
+            continue;  // Skip to next iteration if parsing failed or empty
+        }
+        if (!readHereDocs(pCmdLine, &in, interactive) ||
+            !expandSubstitutions(pCmdLine, cwd)) {
+            freeCmdLines(pCmdLine);
+            continue;
+        }
+
+        // handle quit 
+        if (getCommand(pCmdLine->arguments[0]) == CMD_QUIT) {
+            freeCmdLines(pCmdLine);
+            quit = true;
+            break;
+        }
+
+        status = dispatchCommand(pCmdLine, cwd);
+        commands++;
+        if (status != 0)
+            failures++;
+    }
+
+    // Cleanup
+    fflush(stdout);
+    if (!interactive)
+        fprintf(stderr, "%s: %ld commands, %ld failed, %.3f s\n",
+                opts.script ? opts.script : opts.command ? "-c" : "stdin",
+                commands, failures, (nowNanos() - began) / 1e9);
+    if (debug) {
+        printLatency(&latency);
+        printLineCache(stderr);
+        printJobFootprint(stderr, &process_list);
+    }
+    if (active_feeder)
+        finishFeeder(active_feeder);
+    restoreTerminal();
+    closeInput(&in);
+    freeProcessList(&process_list);
+    freeHistory(&history);
+    freeCommandHash();
+    setLineCacheSize(0);    // frees the cached lines
+    zygoteStop();
+    traceClose();
+    return status;
+}
+
+#endif // MYSHELL_NO_MAIN
+
+// Run a chain of any number of commands joined by pipes.
+// Redirections are honored on the first (<, <<, <<<) and last (>) stage only.
+// A foreground "cat file..." head is fed by the shell itself (see Feeder),
+// and utility builtins (echo, printf, ...) run in the shell (see Utilities).
+// The stages form one job, in a process group of their own under job control.
+// Each stage may carry pin/nice/sched prefixes; with "set spread on" the
+// stages without a pin get consecutive CPUs.
+// Returns the exit status of the last stage (0 when run in background).
+int runPipeline(cmdLine *pCmdLine) {
+    int status = 0;
+    if (!validateNoRedirectConflict(pCmdLine)) {
+        freeCmdLines(pCmdLine);
+        return 2;
+    }
+
+    int n = 0;
+    cmdLine *tail = pCmdLine;
+    for (cmdLine *c = pCmdLine; c; c = c->next, n++)
+        tail = c;
+    bool blocking = tail->blocking;
+
+    // open the edge redirections before launching anything
+    int in_fd = -1, out_fd = -1;
+    if (hasHereText(pCmdLine) && (in_fd = openHereText(pCmdLine)) == -1) {
+        freeCmdLines(pCmdLine);
+        return 1;
+    }
+    if (pCmdLine->inputRedirect &&
+        (in_fd = open(pCmdLine->inputRedirect, O_RDONLY | O_CLOEXEC)) == -1) {
+        DebugMessage("Input redirection open failed", true);
+        freeCmdLines(pCmdLine);
+        return 1;
+    }
+    if (tail->outputRedirect &&
+        (out_fd = open(tail->outputRedirect, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0666)) == -1) {
+        DebugMessage("output redirection open failed", true);
+        if (in_fd != -1)
+            close(in_fd);
+        freeCmdLines(pCmdLine);
+        return 1;
+    }
+
+    pid_t *pids = malloc(n * sizeof(pid_t));
+    if (!pids) { perror("malloc"); freeCmdLines(pCmdLine); return 1; }
+    int job = newJobNumber();
+    pid_t pgid = 0;     // the first launched stage leads the group
+
+    // Pipes are close-on-exec so no stage inherits another stage's ends;
+    // forkAndExec dups the two it needs onto stdin/stdout.
+    int prev_read = in_fd;
+    cmdLine *stage = pCmdLine;
+    for (int i = 0; i < n; i++) {
+        cmdLine *next = stage->next;
+        int pipefd[2] = { -1, -1 };
+        int stage_out = out_fd;
+        if (next) {
+            if (pipe2(pipefd, O_CLOEXEC) == -1) {
+                DebugMessage("pipe", true);
+                freeCmdLines(stage);
+                n = i;
+                break;
+            }
+            stage_out = pipefd[1];
+            sizePipe(stage_out);
+        }
+
+        // Detach so every stage can be freed on its own once launched
+        stage->next = NULL;
+        launchSched sched;
+        int prefixed = 0, utilityStatus;
+        bool feed = i == 0 && blocking && next && !active_feeder && isFeederStage(stage);
+        const builtinEntry *utility = NULL;
+        if (!feed && (prefixed = parseLaunchPrefixes(stage, &sched)) == 0)
+            utility = findBuiltin(stage->arguments[0]);
+        if (utility && !utility->run)
+            utility = NULL;     // shell builtins in a pipeline run externally, as before
+        if (!feed && !utility && prefixed != -1 && settings.spread && !sched.pin) {
+            spreadStage(&sched);
+            prefixed = 1;
+        }
+        if (feed) {
+            // the feeder owns the write end until the files are copied
+            pids[i] = 0;
+            active_feeder = startFeeder(stage, -1, stage_out);
+            stage_out = -1;
+            if (!active_feeder) {
+                freeCmdLines(stage);
+                status = 1;
+            }
+        }
+        else if (utility && runUtility(utility, stage, &stage_out, next != NULL, blocking,
+                                       &utilityStatus)) {
+            // ran in the shell: its output is in the pipe or with the feeder
+            pids[i] = 0;
+            if (!next)
+                status = utilityStatus;
+        }
+        else if (prefixed == -1) {
+            pids[i] = -1;
+            freeCmdLines(stage);
+            status = 2;
+        }
+        else if ((pids[i] = forkAndExec(stage->arguments[0], stage->arguments, prev_read, stage_out,
+                                        pgid ? pgid : job_control ? LAUNCH_NEW_PGROUP : 0,
+                                        prefixed ? &sched : NULL)) < 0) {
+            DebugMessage("launch failed", true);
+            freeCmdLines(stage);
+            status = 127;
+        }
+        else if (pids[i] > 0) {
+            if (job_control && !pgid) {
+                pgid = pids[i];
+                // hand the terminal over before the next stages start
+                if (blocking)
+                    tcsetpgrp(STDIN_FILENO, pgid);
+            }
+            setJob(addProcess(&process_list, stage, pids[i]), job, pgid);
+            DebugChild(pids[i], stage->arguments[0]);
+            freeCmdLines(stage);    // the record keeps its text
+        }
+
+        // parent keeps none of this stage's ends
+        if (prev_read != -1)
+            close(prev_read);
+        if (stage_out != -1)
+            close(stage_out);
+        prev_read = pipefd[0];
+        stage = next;
+    }
+    if (prev_read != -1)
+        close(prev_read);
+    if (out_fd != -1 && stage)
+        close(out_fd);   // aborted before the tail took ownership
+
+    // wait for every stage
+    if (blocking && n > 0 && pids[n - 1] > 0)
+        status = waitForegroundJob(job, pgid, pids, n);
+    else if (blocking)
+        waitForegroundJob(job, pgid, pids, n);
+    else if (job_control && n > 0 && pids[n - 1] > 0)
+        printf("[%d] %d\n", job, pids[n - 1]);
+    free(pids);
+    return status;
+}
+
+// Parses [-d] [-l fork|spawn|zygote] [-H histsize] [-f histfile] [-c command | script],
+// returns false on a usage error. Options stop at the script name.
+bool parseOptions(int argc, char **argv, shellOptions *opts) {
+    int c;
+    opts->debug = false;
+    opts->backend = LAUNCH_SPAWN;
+    opts->command = NULL;
+    opts->script = NULL;
+    opts->histSize = HISTLEN;
+    const char *env = getenv("MYSHELL_HISTSIZE");
+    if (env && atoi(env) > 0)
+        opts->histSize = atoi(env);
+    opts->histFile = getenv("MYSHELL_HISTFILE");
+    while ((c = getopt(argc, argv, "+dl:c:H:f:")) != -1) {
+        switch (c) {
+            case 'd':
+                opts->debug = true;
+                break;
+            case 'l':
+                if ((c = parseLaunchBackend(optarg)) == -1) {
+                    fprintf(stderr, "unknown launch backend: %s\n", optarg);
+                    return false;
+                }
+                opts->backend = c;
+                break;
+            case 'c':
+                opts->command = optarg;
+                break;
+            case 'H':
+                if ((opts->histSize = atoi(optarg)) <= 0) {
+                    fprintf(stderr, "bad history size: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case 'f':
+                opts->histFile = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-d] [-l fork|spawn|zygote] [-H histsize] [-f histfile] "
+                        "[-c command | script]\n", argv[0]);
+                return false;
+        }
+    }
+    if (!opts->command && optind < argc)
+        opts->script = argv[optind];
+    return true;
+}
+
+/// Dispatch a parsed command line, returns its exit status
+int dispatchCommand(cmdLine *pCmdLine, char cwd[]) {
+    bool shouldFree = true;
+    int status = 0;
+
+    // children write straight to fd 1: flush what the shell printed first
+    fflush(stdout);
+    if (getCommand(pCmdLine->arguments[0]) == CMD_TIME)
+        return timeCommand(pCmdLine, cwd);     // times the whole line
+    if (pCmdLine->next) {
+        status = runPipeline(pCmdLine);
+        shouldFree = false;
+    }
+    else {
+        const builtinEntry *builtin = findBuiltin(pCmdLine->arguments[0]);
+        Command cmd = builtin ? builtin->cmd : CMD_EXECUTE;
+        switch (cmd) {
+            case CMD_QUIT: //we'll quit in main
+                break;
+            case CMD_CD:
+                status = cdCommand(
+                    pCmdLine->argCount>1 ? pCmdLine->arguments[1] : NULL,
+                    cwd
+                );
+                break;
+            case CMD_HALT:
+                status = sigCommand(
+                    pCmdLine->arguments[0],
+                    pCmdLine->argCount>1 ? pCmdLine->arguments[1] : NULL,
+                    SIGSTOP
+                );
+                break;
+            case CMD_ICE:
+                status = sigCommand(
+                    pCmdLine->arguments[0],
+                    pCmdLine->argCount>1 ? pCmdLine->arguments[1] : NULL,
+                    SIGINT
+                );
+                break;
+            case CMD_WAKEUP:
+                status = sigCommand(
+                    pCmdLine->arguments[0],
+                    pCmdLine->argCount>1 ? pCmdLine->arguments[1] : NULL,
+                    SIGCONT
+                );
+                break;
+            case CMD_PROCS:
+                printProcessList(&process_list);
+                break;
+            case CMD_HASH:
+                hashCommand(pCmdLine);
+                break;
+            case CMD_CAT:
+                if (pCmdLine->blocking && isFeederStage(pCmdLine)) {
+                    status = catCommand(pCmdLine);
+                    break;
+                }
+                status = execute(pCmdLine);
+                shouldFree = false;
+                break;
+            case CMD_PARALLEL:
+                status = parallelCommand(pCmdLine);
+                break;
+            case CMD_JOBS:
+                status = jobsCommand();
+                break;
+            case CMD_SET:
+                status = setCommand(pCmdLine);
+                break;
+            case CMD_STATS:
+                status = statsCommand(pCmdLine);
+                break;
+            case CMD_FG:
+            case CMD_BG:
+                status = fgCommand(
+                    pCmdLine->argCount>1 ? pCmdLine->arguments[1] : NULL,
+                    cmd == CMD_FG
+                );
+                break;
+            case CMD_UTILITY: {
+                int out_fd = -1;
+                if (pCmdLine->outputRedirect &&
+                    (out_fd = open(pCmdLine->outputRedirect,
+                                   O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0666)) == -1) {
+                    DebugMessage("output redirection open failed", true);
+                    status = 1;
+                    break;
+                }
+                runUtility(builtin, pCmdLine, &out_fd, false, pCmdLine->blocking, &status);
+                shouldFree = false;
+                if (out_fd != -1)
+                    close(out_fd);
+                break;
+            }
+            case CMD_EXECUTE:
+                status = execute(pCmdLine);
+                shouldFree = false;
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (shouldFree)
+        freeCmdLines(pCmdLine);
+    return status;
+}
+
+// executes using the path variables the command with arguemnts given.
+// Returns the exit status of a blocking command, 0 for background ones.
+int execute(cmdLine *pCmdLine) {
+    launchSched sched;
+    int prefixed = parseLaunchPrefixes(pCmdLine, &sched);
+    if (prefixed == -1) {
+        freeCmdLines(pCmdLine);
+        return 2;
+    }
+    int here_fd = -1;
+    if (hasHereText(pCmdLine) && (here_fd = openHereText(pCmdLine)) == -1) {
+        freeCmdLines(pCmdLine);
+        return 1;
+    }
+    const char *path = lookupCommand(pCmdLine->arguments[0]);
+    launchSpec spec = {
+        .path = path ? path : pCmdLine->arguments[0],
+        .argv = pCmdLine->arguments,
+        .in_fd = here_fd,
+        .out_fd = -1,
+        .inputRedirect = pCmdLine->inputRedirect,
+        .outputRedirect = pCmdLine->outputRedirect,
+        .pgid = job_control ? LAUNCH_NEW_PGROUP : 0,
+        .sched = prefixed ? &sched : NULL,
+    };
+    pid_t pid = launchTraced(&spec);
+    if (here_fd != -1)
+        close(here_fd);     // the child has its own descriptor
+    //Error in launch
+    if (pid < 0) {
+        DebugMessage("launch failed", true);
+        freeCmdLines(pCmdLine);
+        return 127;
+    }
+    int job = newJobNumber();
+    pid_t pgid = job_control ? pid : 0;
+    setJob(addProcess(&process_list, pCmdLine, pid), job, pgid);
+    DebugChild(pid, pCmdLine->arguments[0]);
+    bool blocking = pCmdLine->blocking;
+    freeCmdLines(pCmdLine);     // the record keeps its text
+    if (blocking) {
+        return waitForegroundJob(job, pgid, &pid, 1);
+    }
+    if (job_control)
+        printf("[%d] %d\n", job, pid);
+    return 0;
+}
+
+// Builtin registry, looked up through a perfect hash: a seed is searched
+// for at first use under which every name gets a slot of its own, so a
+// lookup is one hash and at most one strcmp, whatever the table size.
+static const builtinEntry builtins[] = {
+    { "quit", CMD_QUIT, NULL },
+    { "cd", CMD_CD, NULL },
+    { "halt", CMD_HALT, NULL },
+    { "wakeup", CMD_WAKEUP, NULL },
+    { "ice", CMD_ICE, NULL },
+    { "procs", CMD_PROCS, NULL },
+    { "hash", CMD_HASH, NULL },
+    { "cat", CMD_CAT, NULL },
+    { "parallel", CMD_PARALLEL, NULL },
+    { "jobs", CMD_JOBS, NULL },
+    { "fg", CMD_FG, NULL },
+    { "bg", CMD_BG, NULL },
+    { "time", CMD_TIME, NULL },
+    { "set", CMD_SET, NULL },
+    { "stats", CMD_STATS, NULL },
+    { "echo", CMD_UTILITY, echoUtility },
+    { "true", CMD_UTILITY, trueUtility },
+    { "false", CMD_UTILITY, falseUtility },
+    { "printf", CMD_UTILITY, printfUtility },
+    { "test", CMD_UTILITY, testUtility },
+    { "[", CMD_UTILITY, testUtility },
+    { "pwd", CMD_UTILITY, pwdUtility },
+    { "kill", CMD_UTILITY, killUtility },
+};
+#define BUILTIN_COUNT (sizeof(builtins) / sizeof(builtins[0]))
+#define BUILTIN_BITS 6      // 64 slots, roomy enough for a quick seed search
+#define BUILTIN_SLOTS (1 << BUILTIN_BITS)
+
+static const builtinEntry *builtinSlots[BUILTIN_SLOTS];
+static unsigned builtinSeed;
+static bool builtinsReady;
+
+// FNV-1a with the seed as offset basis. The slot comes from the top bits:
+// the low bits of the product only ever see the low bits of the seed.
+static unsigned builtinHash(const char *name, unsigned seed) {
+    uint32_t h = seed;
+    for (; *name; name++)
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    return h >> (32 - BUILTIN_BITS);
+}
+
+static void buildBuiltinSlots(void) {
+    for (unsigned seed = 2166136261u; ; seed++) {
+        memset(builtinSlots, 0, sizeof(builtinSlots));
+        size_t i;
+        for (i = 0; i < BUILTIN_COUNT; i++) {
+            const builtinEntry **slot = &builtinSlots[builtinHash(builtins[i].name, seed)];
+            if (*slot)
+                break;
+            *slot = &builtins[i];
+        }
+        if (i == BUILTIN_COUNT) {
+            builtinSeed = seed;
+            builtinsReady = true;
+            return;
+        }
+    }
+}
+
+// The registry entry for name, NULL for external commands.
+const builtinEntry *findBuiltin(const char *name) {
+    if (!builtinsReady)
+        buildBuiltinSlots();
+    const builtinEntry *b = builtinSlots[builtinHash(name, builtinSeed)];
+    return b && strcmp(b->name, name) == 0 ? b : NULL;
+}
+
+// gets a cmd command, and returns the corresponsing enum value
+Command getCommand(const char *cmd) {
+    const builtinEntry *b = findBuiltin(cmd);
+    return b ? b->cmd : CMD_EXECUTE;
+}
+
+// Changes directory to given path, updates cwd variable.
+int cdCommand(const char* path, char *cwd) {
+    if (path == NULL) {
+        if(debug) {
+            DebugMessage("cd: missing operand", false);
+        }
+        return 1;
+    }
+    if (chdir(path) != 0) {
+        if (debug) {
+            DebugMessage("chdir failed", true);
+        }
+        return 1;
+    }
+    getcwd(cwd, PATH_MAX);
+    return 0;
+}
+
+// hash: list remembered command locations, "hash -r" forgets them all,
+// "hash name..." resolves and remembers the given names.
+void hashCommand(cmdLine *pCmdLine) {
+    if (pCmdLine->argCount == 1) {
+        printCommandHash();
+        return;
+    }
+    for (int i = 1; i < pCmdLine->argCount; i++) {
+        const char *name = pCmdLine->arguments[i];
+        if (strcmp(name, "-r") == 0)
+            clearCommandHash();
+        else if (!lookupCommand(name))
+            fprintf(stderr, "hash: %s: not found\n", name);
+    }
+}
+
+// The pid str names, or 0 unless the whole string is a number above 0:
+// kill(0) or kill(-1) would signal the shell's own group or everything.
+static pid_t parsePid(const char *str) {
+    char *end;
+    errno = 0;
+    long pid = strtol(str, &end, 10);
+    if (end == str || *end != '\0' || errno == ERANGE || pid <= 0 || pid > INT_MAX)
+        return 0;
+    return pid;
+}
+
+//sigCommand - Sends the specified signal to the job given as %N, or to the
+// job of the process whose PID is provided by pidStr: every stage at once.
+// A pid that isn't part of a job is signaled alone. name prefixes errors.
+int sigCommand(const char *name, const char *pidStr, int sig) {
+    if(pidStr == NULL) {
+        DebugMessage("PID not provided", false);
+        return 1;
+    }
+    // a pid of 0 would signal the shell's own process group
+    int pid = pidStr[0] == '%' ? 0 : parsePid(pidStr);
+    if (pidStr[0] != '%' && !pid) {
+        fprintf(stderr, "%s: %s: arguments must be process or job IDs\n", name, pidStr);
+        return 1;
+    }
+    int job = findJob(pidStr);
+    if (job == -1 || (!job && !pid)) {
+        fprintf(stderr, "%s: %s: no such job\n", name, pidStr);
+        return 1;
+    }
+    if (job ? signalJob(job, sig) == -1 : kill(pid, sig) == -1) {
+        DebugMessage("signal failed", true);
+        return 1;
+    }
+    else {
+        if (sig == SIGSTOP) {
+            markJob(job, pid, SUSPENDED);
+            DebugMessage("signaled STOP", false);
+        }
+        else if (sig == SIGCONT) {
+            markJob(job, pid, RUNNING);
+            DebugMessage("signaled SIGCONT", false);
+        }
+        else if (sig == SIGINT) {
+            // a stopped job only acts on the signal once continued
+            if (job && jobState(job, &(int){0}) == SUSPENDED)
+                signalJob(job, SIGCONT);
+            markJob(job, pid, TERMINATED);
+            DebugMessage("signaled SIGINT", false);
+        }
+    }
+    return 0;
+}
+
+// Signal number for "TERM", "SIGTERM" or "15", -1 if unknown.
+static int parseSignal(const char *name) {
+    if (isdigit((unsigned char)name[0])) {
+        int sig = atoi(name);
+        return sig < NSIG ? sig : -1;
+    }
+    if (strncasecmp(name, "SIG", 3) == 0)
+        name += 3;
+    for (int sig = 1; sig < NSIG; sig++) {
+        const char *abbrev = sigabbrev_np(sig);
+        if (abbrev && strcasecmp(abbrev, name) == 0)
+            return sig;
+    }
+    return -1;
+}
+
+// kill [-s SIG | -SIG] pid|%job...: any signal, SIGTERM by default. A pid
+// is signaled alone, a %job spec signals every stage of the job.
+int killUtility(int argc, char *const argv[], FILE *out) {
+    int sig = SIGTERM, i = 1, status = 0;
+    (void)out;
+    if (i + 1 < argc && strcmp(argv[i], "-s") == 0) {
+        sig = parseSignal(argv[i + 1]);
+        i += 2;
+    }
+    else if (i < argc && argv[i][0] == '-' && argv[i][1]) {
+        sig = parseSignal(argv[i] + 1);
+        i++;
+    }
+    if (sig == -1 || i >= argc) {
+        fprintf(stderr, "usage: kill [-s SIG | -SIG] pid|%%job...\n");
+        return 2;
+    }
+    for (; i < argc; i++) {
+        const char *target = argv[i];
+        int job = target[0] == '%' ? findJob(target) : 0;
+        if (target[0] == '%' && job <= 0) {
+            fprintf(stderr, "kill: %s: no such job\n", target);
+            status = 1;
+        }
+        else if (!job && !parsePid(target)) {
+            fprintf(stderr, "kill: %s: arguments must be process or job IDs\n", target);
+            status = 1;
+        }
+        else if ((job ? signalJob(job, sig) : kill(parsePid(target), sig)) == -1) {
+            fprintf(stderr, "kill: %s: %s\n", target, strerror(errno));
+            status = 1;
+        }
+    }
+    return status;
+}
+
+// jobs: list every job with its state, then forget the finished ones.
+int jobsCommand(void) {
+    updateProcessList(&process_list);
+    int current = findJob("%%");
+    for (int job = 1, last = newJobNumber(); job < last; job++) {
+        int members;
+        int state = jobState(job, &members);
+        if (!members)
+            continue;
+        printf("[%d]%c  %-10s", job, job == current ? '+' : ' ',
+               state == RUNNING ? "Running" : state == SUSPENDED ? "Stopped" : "Done");
+        printJobCommand(job);
+        putchar('\n');
+    }
+    removeTerminatedProcesses(&process_list);
+    return 0;
+}
+
+// fg/bg [%N | pid]: continue a stopped job (default: the newest) and
+// wait for it holding the terminal (fg), or leave it in the background (bg).
+int fgCommand(const char *spec, bool foreground) {
+    updateProcessList(&process_list);
+    int job = findJob(spec ? spec : "%%");
+    const jobRecord *j = findJobRecord(job);
+    int n = j ? j->running + j->stopped : 0;
+    pid_t pgid = j ? j->pgid : 0;
+    if (n == 0) {
+        fprintf(stderr, "%s: no such job\n", foreground ? "fg" : "bg");
+        return 1;
+    }
+
+    if (!foreground) {
+        printf("[%d]  ", job);
+        printJobCommand(job);
+        printf(" &\n");
+        signalJob(job, SIGCONT);
+        markJob(job, 0, RUNNING);
+        return 0;
+    }
+    // stages in launch order, so the last stage is last
+    pid_t *pids = malloc(n * sizeof(pid_t));
+    if (!pids) { perror("malloc"); return 1; }
+    int i = 0;
+    for (process *p = j->first; p; p = p->jobNext)
+        if (p->status != TERMINATED)
+            pids[i++] = p->pid;
+    printJobCommand(job);
+    putchar('\n');
+    fflush(stdout);
+    if (job_control && pgid)
+        tcsetpgrp(STDIN_FILENO, pgid);
+    signalJob(job, SIGCONT);
+    markJob(job, 0, RUNNING);
+    int status = waitForegroundJob(job, pgid, pids, n);
+    free(pids);
+    return status;
+}
+
+// time cmd [| cmd...]: run the line, then report on stderr its wall time,
+// the CPU of all its stages together (plus the shell's own, for builtins
+// and the cat feeder) and a row per stage, to find the one burning CPU.
+int timeCommand(cmdLine *pCmdLine, char cwd[]) {
+    if (pCmdLine->argCount < 2) {
+        fprintf(stderr, "usage: time cmd [| cmd...]\n");
+        freeCmdLines(pCmdLine);
+        return 2;
+    }
+    // argv lives in the line's arena: stepping past "time" is enough
+    pCmdLine->arguments++;
+    pCmdLine->argCount--;
+
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    long began = nowNanos();
+    timed_lines++;
+    int status = dispatchCommand(pCmdLine, cwd);
+    timed_lines--;
+    long ended = nowNanos();
+    getrusage(RUSAGE_SELF, &after);
+
+    // the line's records were added since, at the head of the list
+    process *first = NULL;
+    for (process *p = process_list.head; p && p->started >= began; p = p->next)
+        first = p;
+    double user = tvSeconds(after.ru_utime) - tvSeconds(before.ru_utime);
+    double sys = tvSeconds(after.ru_stime) - tvSeconds(before.ru_stime);
+    for (process *p = first; p; p = p->prev) {
+        user += p->usage.utime / 1e6;
+        sys += p->usage.stime / 1e6;
+    }
+    fprintf(stderr, "real\t%.3fs\nuser\t%.3fs\nsys\t%.3fs\n",
+            (ended - began) / 1e9, user, sys);
+    if (first)
+        fprintf(stderr, "%-12s%-12s%8s%8s%10s%14s%9s\n",
+                "PID", "Command", "USER", "SYS", "MAXRSS", "CSW", "WALL");
+    for (process *p = first; p; p = p->prev) {
+        fprintf(stderr, "%-12d%-12.*s", p->pid, (int)strcspn(p->cmd->text, " "), p->cmd->text);
+        printUsage(stderr, p);
+        fputc('\n', stderr);
+    }
+    // the finished foreground stages were kept for this report only
+    for (process *p = first, *prev; p && !timed_lines; p = prev) {
+        prev = p->prev;
+        if (p->status == TERMINATED && !p->job)
+            removeProcess(&process_list, p);
+    }
+    return status;
+}
+// Largest pipe an unprivileged process may ask for.
+static long pipeMaxSize(void) {
+    long max = 1 << 20;     // the kernel's default limit
+    FILE *f = fopen("/proc/sys/fs/pipe-max-size", "r");
+    if (f) {
+        if (fscanf(f, "%ld", &max) != 1)
+            max = 1 << 20;
+        fclose(f);
+    }
+    return max;
+}
+
+// "256K", "1M", a byte count, or "default" (0).
+static bool parseSize(const char *str, long *size) {
+    char *end;
+    if (strcmp(str, "default") == 0) {
+        *size = 0;
+        return true;
+    }
+    int shift = 0;
+    errno = 0;
+    *size = strtol(str, &end, 10);
+    if (end == str || *size < 0 || errno == ERANGE)
+        return false;
+    if (*end == 'K' || *end == 'k')
+        shift = 10, end++;
+    else if (*end == 'M' || *end == 'm')
+        shift = 20, end++;
+    if (*size > LONG_MAX >> shift)
+        return false;   // the shift would overflow
+    *size <<= shift;
+    return *end == '\0';
+}
+
+// set [name value]: list the settings, or change one.
+//   spread on|off          pin each pipeline stage to a CPU of its own
+//   pipebuf SIZE|default   buffer size of pipeline pipes, capped by
+//                          /proc/sys/fs/pipe-max-size
+int setCommand(cmdLine *pCmdLine) {
+    char * const *args = pCmdLine->arguments;
+    long size;
+    if (pCmdLine->argCount == 1) {
+        printf("spread\t%s\n", settings.spread ? "on" : "off");
+        if (!settings.pipebuf)
+            printf("pipebuf\tdefault\n");
+        else if (settings.pipebuf % (1 << 20) == 0)
+            printf("pipebuf\t%dM\n", settings.pipebuf >> 20);
+        else if (settings.pipebuf % (1 << 10) == 0)
+            printf("pipebuf\t%dK\n", settings.pipebuf >> 10);
+        else
+            printf("pipebuf\t%d\n", settings.pipebuf);
+        lineCacheStats cache;
+        getLineCacheStats(&cache);
+        if (cache.capacity)
+            printf("linecache\t%d\n", cache.capacity);
+        else
+            printf("linecache\toff\n");
+        return 0;
+    }
+    if (pCmdLine->argCount == 3 && strcmp(args[1], "spread") == 0 &&
+        (strcmp(args[2], "on") == 0 || strcmp(args[2], "off") == 0)) {
+        settings.spread = strcmp(args[2], "on") == 0;
+        return 0;
+    }
+    if (pCmdLine->argCount == 3 && strcmp(args[1], "pipebuf") == 0 && parseSize(args[2], &size)) {
+        long max = pipeMaxSize();
+        settings.pipebuf = size > max ? max : size;
+        return 0;
+    }
+    if (pCmdLine->argCount == 3 && strcmp(args[1], "linecache") == 0) {
+        char *end = "";
+        bool off = strcmp(args[2], "off") == 0;
+        long n = off ? 0 : strtol(args[2], &end, 10);
+        if (off || (end != args[2] && !*end && n >= 0 && n <= 1 << 20)) {
+            setLineCacheSize((int)n);
+            return 0;
+        }
+    }
+    fprintf(stderr, "usage: set [spread on|off | pipebuf SIZE[K|M]|default | linecache N|off]\n");
+    return 2;
+}
+
+// stats [-d] [-w file] [-r]: percentiles of parse time, spawn latency and
+// job duration. -d adds each one's full distribution, -w appends the event
+// ring to file as JSON lines, -r starts over. With -w or -r alone nothing
+// is printed.
+int statsCommand(cmdLine *pCmdLine) {
+    bool distribution = false, print = pCmdLine->argCount == 1;
+    for (int i = 1; i < pCmdLine->argCount; i++) {
+        const char *arg = pCmdLine->arguments[i];
+        if (strcmp(arg, "-d") == 0)
+            distribution = print = true;
+        else if (strcmp(arg, "-r") == 0) {
+            traceReset();
+            resetLineCacheStats();
+        }
+        else if (strcmp(arg, "-w") == 0 && i + 1 < pCmdLine->argCount) {
+            if (!traceWrite(pCmdLine->arguments[++i])) {
+                perror(pCmdLine->arguments[i]);
+                return 1;
+            }
+        }
+        else {
+            fprintf(stderr, "usage: stats [-d] [-w file] [-r]\n");
+            return 2;
+        }
+    }
+    if (print) {
+        tracePrintStats(stdout, distribution);
+        printLineCache(stdout);
+        printJobFootprint(stdout, &process_list);
+    }
+    return 0;
+}
+
+// Parsed-line cache counters, see parseCachedCmdLines.
+void printLineCache(FILE *out) {
+    lineCacheStats c;
+    getLineCacheStats(&c);
+    long lookups = c.hits + c.misses;
+    fprintf(out, "linecache: %ld hits, %ld misses (%.1f%% hit), %ld evictions; "
+            "%d/%d lines, %zu bytes\n", c.hits, c.misses,
+            lookups ? 100.0 * c.hits / lookups : 0.0, c.evictions,
+            c.entries, c.capacity, c.bytes);
+}
+
+// ——— Process —————————————————————————————————————————————
+static process tombstone;
+
+static unsigned pidSlot(const process_table *t, pid_t pid) {
+    return ((unsigned)pid * 2654435761u) & (t->cap - 1);
+}
+
+// Returns the slot holding pid, or the slot it would be inserted in.
+static process **probeProcess(process_table *t, pid_t pid) {
+    process **free_slot = NULL;
+    for (unsigned i = pidSlot(t, pid); ; i = (i + 1) & (t->cap - 1)) {
+        process *p = t->slots[i];
+        if (!p)
+            return free_slot ? free_slot : &t->slots[i];
+        if (p == &tombstone) {
+            if (!free_slot)
+                free_slot = &t->slots[i];
+        }
+        else if (p->pid == pid)
+            return &t->slots[i];
+    }
+}
+
+// Rebuild the index at the given capacity, dropping tombstones. The list
+// runs newest first, so a slot already taken belongs to the newest record
+// for a reused pid and an older, finished one must not replace it.
+static bool rehashProcesses(process_table *t, int cap) {
+    process **slots = calloc(cap, sizeof(process *));
+    if (!slots)
+        return false;
+    free(t->slots);
+    t->slots = slots;
+    t->cap = cap;
+    t->used = 0;
+    for (process *p = t->head; p; p = p->next) {
+        process **slot = probeProcess(t, p->pid);
+        if (!*slot) {
+            *slot = p;
+            t->used++;
+        }
+    }
+    return true;
+}
+
+static unsigned textHash(const char *s) {
+    unsigned h = 2166136261u;   // FNV-1a
+    for (; *s; s++)
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+// The line's words joined by spaces, cut to JOB_TEXT_MAX - 1 bytes with
+// "..." marking a cut.
+static void commandString(const cmdLine *cmd, char *buf) {
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < cmd->argCount; i++) {
+        int n = snprintf(buf + len, JOB_TEXT_MAX - len, i ? " %s" : "%s", cmd->arguments[i]);
+        if (n < 0 || (size_t)n >= JOB_TEXT_MAX - len) {
+            memcpy(buf + JOB_TEXT_MAX - 4, "...", 4);
+            return;
+        }
+        len += n;
+    }
+}
+
+// Returns the table's copy of cmd's text with a reference taken, NULL if
+// it can't be allocated.
+static commandText *internCommand(process_table *t, const cmdLine *cmd) {
+    if (t->textCount >= t->textCap) {
+        // chains stay around one entry long
+        int cap = t->textCap ? t->textCap * 2 : 64;
+        commandText **texts = calloc(cap, sizeof(commandText *));
+        if (!texts)
+            return NULL;
+        for (int i = 0; i < t->textCap; i++)
+            for (commandText *c = t->texts[i], *next; c; c = next) {
+                next = c->next;
+                c->next = texts[c->hash & (cap - 1)];
+                texts[c->hash & (cap - 1)] = c;
+            }
+        free(t->texts);
+        t->texts = texts;
+        t->textCap = cap;
+    }
+    char buf[JOB_TEXT_MAX];
+    commandString(cmd, buf);
+    unsigned hash = textHash(buf);
+    commandText **chain = &t->texts[hash & (t->textCap - 1)];
+    for (commandText *c = *chain; c; c = c->next)
+        if (c->hash == hash && strcmp(c->text, buf) == 0) {
+            c->refs++;
+            return c;
+        }
+    size_t size = sizeof(commandText) + strlen(buf) + 1;
+    commandText *c = malloc(size);
+    if (!c)
+        return NULL;
+    c->hash = hash;
+    c->refs = 1;
+    strcpy(c->text, buf);
+    c->next = *chain;
+    *chain = c;
+    t->textCount++;
+    t->textBytes += size;
+    return c;
+}
+
+static void releaseCommand(process_table *t, commandText *text) {
+    if (--text->refs > 0)
+        return;
+    commandText **c = &t->texts[text->hash & (t->textCap - 1)];
+    while (*c != text)
+        c = &(*c)->next;
+    *c = text->next;
+    t->textCount--;
+    t->textBytes -= sizeof(commandText) + strlen(text->text) + 1;
+    free(text);
+}
+
+// A record from the free list, refilled a chunk at a time.
+static process *allocProcess(process_table *t) {
+    if (!t->free) {
+        processChunk *chunk = malloc(sizeof(processChunk));
+        if (!chunk)
+            return NULL;
+        chunk->next = t->chunks;
+        t->chunks = chunk;
+        t->chunkCount++;
+        for (int i = PROCESS_CHUNK - 1; i >= 0; i--) {
+            chunk->records[i].next = t->free;
+            t->free = &chunk->records[i];
+        }
+    }
+    process *p = t->free;
+    t->free = p->next;
+    return p;
+}
+
+static void freeProcess(process_table *t, process *p) {
+    releaseCommand(t, p->cmd);
+    p->next = t->free;
+    t->free = p;
+}
+
+// Memory held by the job table: the record slab, the pid index and the
+// interned command texts.
+void printJobFootprint(FILE *out, const process_table *plist) {
+    size_t slab = plist->chunkCount * sizeof(processChunk);
+    size_t index = plist->cap * sizeof(process *);
+    size_t texts = plist->textCap * sizeof(commandText *) + plist->textBytes;
+    fprintf(out, "jobs: %d records, %zu bytes each; slab %zu bytes (%d chunks), "
+            "index %zu bytes, %d command texts %zu bytes; %zu bytes in all\n",
+            plist->count, sizeof(process), slab, plist->chunkCount,
+            index, plist->textCount, texts, slab + index + texts);
+}
+
+// The record of job, the table grown to hold it; NULL if it can't be.
+static jobRecord *jobRecordFor(process_table *t, int job) {
+    if (job >= t->jobCap) {
+        int cap = t->jobCap ? t->jobCap : 16;
+        while (cap <= job)
+            cap *= 2;
+        jobRecord *jobs = realloc(t->jobs, cap * sizeof(jobRecord));
+        if (!jobs)
+            return NULL;
+        memset(jobs + t->jobCap, 0, (cap - t->jobCap) * sizeof(jobRecord));
+        t->jobs = jobs;
+        t->jobCap = cap;
+    }
+    return &t->jobs[job];
+}
+
+// The record of a job with stages in the table, NULL for any other number.
+jobRecord *findJobRecord(int job) {
+    if (job <= 0 || job >= process_list.jobCap || !process_list.jobs[job].members)
+        return NULL;
+    return &process_list.jobs[job];
+}
+
+// Every status change goes through here, so the job's counts follow it.
+static void setStatus(process_table *t, process *p, int status) {
+    if (p->job) {
+        jobRecord *j = &t->jobs[p->job];
+        j->running += (status == RUNNING) - (p->status == RUNNING);
+        j->stopped += (status == SUSPENDED) - (p->status == SUSPENDED);
+    }
+    p->status = status;
+}
+
+// Take p out of its job, dropping the job once it has no stage left.
+static void leaveJob(process_table *t, process *p) {
+    jobRecord *j = &t->jobs[p->job];
+    process **link = &j->first, *prev = NULL;
+    while (*link != p) {
+        prev = *link;
+        link = &prev->jobNext;
+    }
+    *link = p->jobNext;
+    if (j->last == p)
+        j->last = prev;
+    j->members--;
+    j->running -= p->status == RUNNING;
+    j->stopped -= p->status == SUSPENDED;
+    p->job = 0;
+    while (t->lastJob && !t->jobs[t->lastJob].members)
+        t->lastJob--;
+}
+
+// Records a launched child. Only cmd's text is kept, so the caller still
+// owns the line and frees it once it's done launching.
+process *addProcess(process_table *plist, const cmdLine *cmd, pid_t pid) {
+    // keep the index at most 3/4 full, counting tombstones
+    if ((plist->used + 1) * 4 > plist->cap * 3) {
+        int cap = plist->cap ? plist->cap : 64;
+        while ((plist->count + 1) * 2 > cap)
+            cap *= 2;
+        if (!rehashProcesses(plist, cap)) { perror("calloc"); return NULL; }
+    }
+    process *p = allocProcess(plist);
+    if (!p) { perror("malloc"); return NULL; }
+    if (!(p->cmd = internCommand(plist, cmd))) {
+        perror("malloc");
+        p->next = plist->free;
+        plist->free = p;
+        return NULL;
+    }
+    p->pid = pid;
+    p->status = RUNNING;
+    p->exitCode = 0;
+    p->job = 0;
+    p->pgid = 0;
+    p->jobNext = NULL;
+    memset(&p->usage, 0, sizeof(p->usage));
+    p->started = nowNanos();
+    p->ended = 0;
+    p->prev = NULL;
+    p->next = plist->head;
+    if (plist->head)
+        plist->head->prev = p;
+    plist->head = p;
+
+    process **slot = probeProcess(plist, pid);
+    if (*slot && *slot != &tombstone) {
+        // pid reused after an unpruned record: the new child wins
+        setStatus(plist, *slot, TERMINATED);
+    }
+    else if (!*slot) {
+        plist->used++;
+    }
+    *slot = p;
+    plist->count++;
+    return p;
+}
+
+// Returns the process entry for pid, NULL if it isn't tracked.
+process *findProcess(pid_t pid) {
+    if (!process_list.cap)
+        return NULL;
+    process *p = *probeProcess(&process_list, pid);
+    return p == &tombstone ? NULL : p;
+}
+
+// Record a state change reported by wait4, with the resource usage of
+// a child that ended.
+// A job is done once its last process is reaped, and took from the start
+// of its first process (see addProcess) until then. A process outside any
+// job is a job of its own.
+static void traceJobDone(const process *p) {
+    long first = p->started;
+    if (p->job) {
+        const jobRecord *j = &process_list.jobs[p->job];
+        if (j->running || j->stopped)
+            return;
+        first = j->first->started;
+    }
+    traceEvent(TRACE_JOB_DONE, p->pid, p->job, p->ended - first, p->ended);
+    traceSample(TRACE_JOB_DURATION, p->ended - first);
+}
+
+static void recordChildState(pid_t pid, int status, const struct rusage *usage) {
+    process *p = findProcess(pid);
+    if (!p)
+        return;
+    if (WIFEXITED(status)) {
+        setStatus(&process_list, p, TERMINATED);
+        p->exitCode = WEXITSTATUS(status);
+    }
+    else if (WIFSIGNALED(status)) {
+        setStatus(&process_list, p, TERMINATED);
+        p->exitCode = 128 + WTERMSIG(status);
+    }
+    else if (WIFSTOPPED(status)) {
+        setStatus(&process_list, p, SUSPENDED);
+        p->exitCode = 128 + WSTOPSIG(status);
+    }
+    else if (WIFCONTINUED(status)) {
+        setStatus(&process_list, p, RUNNING);
+    }
+    if (p->status == TERMINATED) {
+        p->usage.utime = usage->ru_utime.tv_sec * 1000000L + usage->ru_utime.tv_usec;
+        p->usage.stime = usage->ru_stime.tv_sec * 1000000L + usage->ru_stime.tv_usec;
+        p->usage.maxrss = usage->ru_maxrss;
+        p->usage.nvcsw = usage->ru_nvcsw;
+        p->usage.nivcsw = usage->ru_nivcsw;
+        p->ended = nowNanos();
+        traceEvent(TRACE_EXIT, pid, p->job, p->exitCode, p->ended);
+        traceJobDone(p);
+    }
+}
+
+// Reap one child that changed state, waiting for one unless options has
+// WNOHANG. Returns its pid, 0 if none is ready, -1 on error.
+pid_t reapChild(int options) {
+    struct rusage usage;
+    int status;
+    pid_t pid = wait4(-1, &status, options | WUNTRACED | WCONTINUED, &usage);
+    if (pid > 0)
+        recordChildState(pid, status, &usage);
+    return pid;
+}
+
+// Reap every child whose state changed since the last call. Each wait4
+// reports one changed child, so the cost follows the number of changes,
+// not the number of jobs.
+void updateProcessList(process_table *plist) {
+    (void)plist;    // children are matched to records by pid
+    while (reapChild(WNOHANG) > 0)
+        ;
+}
+
+/**
+ * Find the process with the given pid in process_list
+ * and set its status field to the new value.
+ */
+void updateProcessStatus(process_table *plist, int pid, int status) {
+    process *p = plist->cap ? *probeProcess(plist, pid) : NULL;
+    if (p && p != &tombstone)
+        setStatus(plist, p, status);
+}
+
+// USER SYS MAXRSS CSW WALL columns of a record. The resource figures come
+// with the reap, so a live process only shows its wall time so far.
+void printUsage(FILE *out, const process *p) {
+    double wall = ((p->ended ? p->ended : nowNanos()) - p->started) / 1e9;
+    if (!p->ended) {
+        fprintf(out, "%8s%8s%10s%14s%9.3f", "-", "-", "-", "-", wall);
+        return;
+    }
+    char csw[32];   // voluntary/involuntary
+    snprintf(csw, sizeof(csw), "%d/%d", p->usage.nvcsw, p->usage.nivcsw);
+    fprintf(out, "%8.3f%8.3f%9ldK%14s%9.3f",
+            p->usage.utime / 1e6, p->usage.stime / 1e6, p->usage.maxrss, csw, wall);
+}
+
+// Prints process List PID Command STATUS and the resource columns
+void printProcessList(process_table *plist) {
+    updateProcessList(plist);
+
+    // Header 
+    printf("%-12s%-12s%-12s%8s%8s%10s%14s%9s\n",
+           "PID", "Command", "STATUS", "USER", "SYS", "MAXRSS", "CSW", "WALL");
+    // Entries
+    for (process *p = plist->head; p; p = p->next) {
+        const char *statusStr = 
+            (p->status == RUNNING)   ? "Running"    :
+            (p->status == SUSPENDED) ? "Suspended"  :
+                                       "Terminated";
+
+        // PID, command and status left-aligned in width 12, then usage
+        printf("%-12d%-12.*s%-12s",
+               p->pid,
+               (int)strcspn(p->cmd->text, " "), p->cmd->text,
+               statusStr);
+        printUsage(stdout, p);
+        putchar('\n');
+    }
+
+    // Clean up the terminated processes
+    removeTerminatedProcesses(plist);
+}
+
+// Unlink cur from the ordered view, the index and its job, then free it.
+void removeProcess(process_table *plist, process *cur) {
+    if (cur->prev)
+        cur->prev->next = cur->next;
+    else
+        plist->head = cur->next;
+    if (cur->next)
+        cur->next->prev = cur->prev;
+    process **slot = probeProcess(plist, cur->pid);
+    if (*slot == cur) {
+        *slot = &tombstone;
+    }
+    plist->count--;
+    if (cur->job)
+        leaveJob(plist, cur);
+    freeProcess(plist, cur);
+}
+
+void removeTerminatedProcesses(process_table *plist) {
+    process *cur = plist->head;
+    while (cur) {
+        process *next = cur->next;     // advance before freeing
+        if (cur->status == TERMINATED)
+            removeProcess(plist, cur);
+        cur = next;
+    }
+}
+
+// Free the table on shell exit
+void freeProcessList(process_table *plist) {
+    for (processChunk *c = plist->chunks, *next; c; c = next) {
+        next = c->next;
+        free(c);
+    }
+    for (int i = 0; i < plist->textCap; i++)
+        for (commandText *c = plist->texts[i], *next; c; c = next) {
+            next = c->next;
+            free(c);
+        }
+    free(plist->texts);
+    free(plist->jobs);
+    free(plist->slots);
+    memset(plist, 0, sizeof(*plist));
+}
+
+// ——— Jobs ————————————————————————————————————————————————
+
+// Interactive shells run every job in a process group of its own. Wait
+// until the shell owns the terminal, ignore the terminal's job-control
+// signals (children get them back at exec), then lead a group of our own.
+void initJobControl(void) {
+    while (tcgetpgrp(STDIN_FILENO) != (original_pgrp = getpgrp()))
+        kill(-original_pgrp, SIGTTIN);
+    const int sigs[] = { SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU };
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    for (size_t i = 0; i < sizeof(sigs) / sizeof(sigs[0]); i++) {
+        signal(sigs[i], SIG_IGN);
+        sigaddset(&defaults, sigs[i]);
+    }
+    initLaunchSignals(&defaults);
+    setpgid(0, 0);      // fails harmlessly for a session leader
+    shell_pgid = getpgrp();
+    if (tcsetpgrp(STDIN_FILENO, shell_pgid) == -1) {
+        DebugMessage("tcsetpgrp", true);
+        return;
+    }
+    tcgetattr(STDIN_FILENO, &shell_tmodes);
+    job_control = true;
+}
+
+// Give the terminal back to whoever had it when the shell started.
+void restoreTerminal(void) {
+    if (job_control)
+        tcsetpgrp(STDIN_FILENO, original_pgrp);
+}
+
+// Jobs are numbered from 1 above the highest one in the table; finished
+// background jobs keep their number until jobs or procs reports them.
+int newJobNumber(void) {
+    return process_list.lastJob + 1;
+}
+
+// Resolves "%N", "%%" or "%+" (the newest job) or a pid to a job number.
+// Returns 0 for a pid outside any job (or no job at all for "%%"),
+// -1 for a %N that names no job.
+int findJob(const char *spec) {
+    if (spec[0] != '%') {
+        pid_t pid = parsePid(spec);
+        process *p = pid ? findProcess(pid) : NULL;
+        return p ? p->job : 0;
+    }
+    int newest = process_list.lastJob;
+    while (newest && !(process_list.jobs[newest].running || process_list.jobs[newest].stopped))
+        newest--;
+    if (strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0 || spec[1] == '\0')
+        return newest;
+    int members, job = atoi(spec + 1);
+    jobState(job, &members);
+    return job > 0 && members ? job : -1;
+}
+
+// Make p the next stage of job (none if job is 0), in group pgid.
+void setJob(process *p, int job, pid_t pgid) {
+    if (!p)
+        return;
+    p->pgid = pgid;
+    jobRecord *j = job ? jobRecordFor(&process_list, job) : NULL;
+    if (!j)
+        return;
+    p->job = job;
+    if (j->last)
+        j->last->jobNext = p;
+    else
+        j->first = p;
+    j->last = p;
+    j->pgid = pgid;
+    j->members++;
+    j->running += p->status == RUNNING;
+    j->stopped += p->status == SUSPENDED;
+    if (job > process_list.lastJob)
+        process_list.lastJob = job;
+}
+
+// Stopped if any stage is stopped, else running if any runs, else
+// terminated. members gets the number of stages still in the table.
+int jobState(int job, int *members) {
+    const jobRecord *j = findJobRecord(job);
+    *members = j ? j->members : 0;
+    return !j ? TERMINATED : j->stopped ? SUSPENDED : j->running ? RUNNING : TERMINATED;
+}
+
+// Set the status of every live stage of job, or of pid alone if job is 0.
+void markJob(int job, pid_t pid, int status) {
+    if (!job) {
+        updateProcessStatus(&process_list, pid, status);
+        return;
+    }
+    const jobRecord *j = findJobRecord(job);
+    for (process *p = j ? j->first : NULL; p; p = p->jobNext)
+        if (p->status != TERMINATED)
+            setStatus(&process_list, p, status);
+}
+
+// Signal a whole job: its process group in one call when it has one,
+// each stage in turn otherwise. Returns -1 if nothing was signaled.
+int signalJob(int job, int sig) {
+    int rc = -1;
+    errno = ESRCH;
+    const jobRecord *j = findJobRecord(job);
+    for (process *p = j ? j->first : NULL; p; p = p->jobNext) {
+        if (p->status == TERMINATED)
+            continue;
+        if (p->pgid)
+            return killpg(p->pgid, sig);
+        if (kill(p->pid, sig) == 0)
+            rc = 0;
+    }
+    return rc;
+}
+
+// Print the job's stages as typed, "a | b | c".
+void printJobCommand(int job) {
+    const jobRecord *j = findJobRecord(job);
+    const char *sep = "";
+    for (process *p = j ? j->first : NULL; p; p = p->jobNext) {
+        printf("%s%s", sep, p->cmd->text);
+        sep = " | ";
+    }
+}
+
+// Wait for a foreground job with the terminal handed to its group, then
+// take the terminal back. A job stopped by ^Z is reported and stays in
+// the table for fg/bg. Returns the exit status of the last stage.
+int waitForegroundJob(int job, pid_t pgid, const pid_t *pids, int n) {
+    if (job_control && pgid)
+        tcsetpgrp(STDIN_FILENO, pgid);
+    int status = waitForeground(pids, n);
+
+    // a stage that touched the terminal before the handoff was stopped by
+    // SIGTTIN/SIGTTOU: its group owns the terminal now, let it go on
+    bool early = false;
+    const jobRecord *j = findJobRecord(job);
+    for (process *p = j ? j->first : NULL; p; p = p->jobNext)
+        early |= p->status == SUSPENDED &&
+                 (p->exitCode == 128 + SIGTTIN || p->exitCode == 128 + SIGTTOU);
+    if (job_control && pgid && early) {
+        killpg(pgid, SIGCONT);
+        markJob(job, 0, RUNNING);
+        status = waitForeground(pids, n);
+    }
+
+    if (job_control) {
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes);
+    }
+    int members;
+    if (jobState(job, &members) == SUSPENDED) {
+        printf("\n[%d]+  Stopped   ", job);
+        printJobCommand(job);
+        putchar('\n');
+        return status;
+    }
+    if (job_control && status == 128 + SIGINT)
+        putchar('\n');     // the ^C echo left the prompt mid-line
+    // done in the foreground: its stages are no longer a job, and a reaped
+    // one can't be asked about any more (only time reports them, and
+    // drops them itself), so its record goes back to the slab
+    if ((j = findJobRecord(job)))
+        while (j->first) {
+            if (j->first->status == TERMINATED && !timed_lines)
+                removeProcess(&process_list, j->first);
+            else
+                leaveJob(&process_list, j->first);
+        }
+    return status;
+}
+
+// ——— History —————————————————————————————————————————————
+
+static const char *historyGetter(void *ctx, long n) {
+    return getHistory(ctx, n);
+}
+
+// initialize to empty, holding up to capacity entries, or attach to the
+// shared history file at path (nothing is loaded: entries are read from
+// its mapping on demand)
+bool initHistory(history_list *h, int capacity, const char *path) {
+    memset(h, 0, sizeof(*h));
+    if (path && *path)
+        return (h->file = histFileOpen(path)) != NULL;
+    h->index = histIndexCreate(historyGetter, h);
+    h->capacity = capacity;
+    h->offsets = malloc(capacity * sizeof(size_t));
+    h->slabCap = 4096;
+    h->slab = malloc(h->slabCap);
+    if (!h->offsets || !h->slab) {
+        perror("malloc");
+        freeHistory(h);
+        return false;
+    }
+    return true;
+}
+
+// free the ring & slab
+void freeHistory(history_list *h) {
+    histFileClose(h->file);
+    histIndexFree(h->index);
+    free(h->offsets);
+    free(h->slab);
+    memset(h, 0, sizeof(*h));
+}
+
+// Bring the search index up to the newest entry. A file history is only
+// indexed once it is first searched, so opening it stays free. Evicted
+// entries linger in the index as dead postings; once a full capacity of
+// them has piled up the index is rebuilt over what is still kept.
+static void syncHistoryIndex(history_list *h) {
+    long total = h->file ? histFileCount(h->file) : h->total;
+    long oldest = h->file ? 1 : h->total - h->count + 1;
+
+    if (!h->index)
+        return;
+    if (histIndexLast(h->index) > total ||
+        (!h->file && oldest - h->indexFloor > h->capacity)) {
+        histIndexClear(h->index);
+        h->indexFloor = oldest;
+    }
+    // evicted numbers are skipped: after a rebuild, the last indexed is 0
+    long first = histIndexLast(h->index) + 1;
+    for (long n = first > oldest ? first : oldest; n <= total; n++) {
+        const char *cmd = getHistory(h, n);
+        if (cmd)
+            histIndexAdd(h->index, n, cmd);
+    }
+}
+
+static bool ensureHistoryIndex(history_list *h) {
+    if (!h->index && !(h->index = histIndexCreate(historyGetter, h)))
+        return false;
+    syncHistoryIndex(h);
+    return true;
+}
+
+// latest entry starting with prefix (!prefix), 0 if none
+long searchHistoryPrefix(history_list *h, const char *prefix) {
+    return ensureHistoryIndex(h) ? histIndexPrefix(h->index, prefix) : 0;
+}
+
+static void printMatch(long n, const char *cmd, void *arg) {
+    (void)arg;
+    printf("%2ld  %s\n", n, cmd);
+}
+
+// hist -s: print every kept entry containing pattern, returns the count
+long searchHistory(history_list *h, const char *pattern) {
+    long total = h->file ? histFileCount(h->file) : h->total;
+    long oldest = h->file ? 1 : h->total - h->count + 1;
+    if (!ensureHistoryIndex(h))
+        return 0;
+    return histIndexSearch(h->index, pattern, oldest, total, printMatch, NULL);
+}
+
+// add a new command, evicting the oldest if full
+void addHistory(history_list *h, const char *cmd) {
+    if (h->file) {
+        if (!histFileAppend(h->file, cmd))
+            DebugMessage("history append failed", true);
+        syncHistoryIndex(h);
+        return;
+    }
+
+    size_t len = strlen(cmd) + 1;
+
+    if (h->count == h->capacity) {
+        h->first = (h->first + 1) % h->capacity;
+        h->count--;
+    }
+
+    if (h->used - h->base + len > h->slabCap) {
+        // slide the live run to the front of the slab
+        size_t live_start = h->count ? h->offsets[h->first] : h->used;
+        size_t live = h->used - live_start;
+        memmove(h->slab, h->slab + (live_start - h->base), live);
+        h->base = live_start;
+
+        if (live + len > h->slabCap) {
+            size_t cap = h->slabCap;
+            while (live + len > cap)
+                cap *= 2;
+            char *slab = realloc(h->slab, cap);
+            if (!slab) {
+                perror("realloc");
+                return;
+            }
+            h->slab = slab;
+            h->slabCap = cap;
+        }
+    }
+
+    memcpy(h->slab + (h->used - h->base), cmd, len);
+    h->offsets[(h->first + h->count) % h->capacity] = h->used;
+    h->used += len;
+    h->count++;
+    h->total++;
+    syncHistoryIndex(h);
+}
+
+// print entries from..to (inclusive, clamped to what is kept)
+void printHistory(const history_list *h, long from, long to) {
+    long total = h->file ? histFileCount(h->file) : h->total;
+    long oldest = h->file ? 1 : h->total - h->count + 1;
+    if (from < oldest)
+        from = oldest;
+    if (to > total)
+        to = total;
+    for (long n = from; n <= to; n++) {
+        printf("%2ld  %s\n", n, getHistory(h, n));
+    }
+}
+
+// get the nth (1-based, counted since the shell started) entry, or NULL
+const char *getHistory(const history_list *h, int n) {
+    if (h->file)
+        return histFileGet(h->file, n);
+    long oldest = h->total - h->count + 1;
+    if (n < oldest || n > h->total)
+        return NULL;
+    size_t off = h->offsets[(h->first + (n - oldest)) % h->capacity];
+    return h->slab + (off - h->base);
+}
+
+// get the last (most recent) entry, or NULL
+const char *getLastHistory(const history_list *h) {
+    return getHistory(h, h->file ? histFileCount(h->file) : h->total);
+}
+
+// hist [count | from-to | -s pattern]: the whole history, the last count
+// entries, the entries numbered from..to, or the entries containing
+// pattern. Returns false on a malformed argument.
+bool histCommand(history_list *h, const char *args) {
+    long total = h->file ? histFileCount(h->file) : h->total;
+    long from = 1, to = total;
+    char *end;
+
+    while (isspace((unsigned char)*args))
+        args++;
+    if (strncmp(args, "-s", 2) == 0 && (args[2] == '\0' || isspace((unsigned char)args[2]))) {
+        args += 2;
+        while (isspace((unsigned char)*args))
+            args++;
+        if (!*args)
+            return false;
+        searchHistory(h, args);
+        return true;
+    }
+    if (*args) {
+        long a = strtol(args, &end, 10);
+        if (end == args || a < 0)
+            return false;
+        if (*end == '-') {
+            const char *b = end + 1;
+            from = a;
+            to = strtol(b, &end, 10);
+            if (end == b)
+                return false;
+        }
+        else {
+            from = total - a + 1;
+        }
+        while (isspace((unsigned char)*end))
+            end++;
+        if (*end)
+            return false;
+    }
+    printHistory(h, from, to);
+    return true;
+}
+
+
+// Appends len bytes to the growable expansion buffer.
+static bool appendExpansion(char **buf, size_t *cap, size_t *w, const char *src, size_t len) {
+    if (*w + len + 1 > *cap) {
+        size_t ncap = *cap ? *cap : 256;
+        while (ncap < *w + len + 1)
+            ncap *= 2;
+        char *nbuf = realloc(*buf, ncap);
+        if (!nbuf)
+            return false;
+        *buf = nbuf;
+        *cap = ncap;
+    }
+    memcpy(*buf + *w, src, len);
+    *w += len;
+    return true;
+}
+
+// Returns true if we handled a “hist” command (so caller should continue),
+// or false if input has been rewritten (or left alone) and should be executed.
+// A rewritten *input points at a buffer owned by this function.
+bool expandHistoryLine(history_list *history, char **input) {
+    // Handle “hist” as a special case
+    if (strncmp(*input, "hist", 4) == 0 &&
+        ((*input)[4] == '\0' || isspace((unsigned char)(*input)[4]))) {
+        if (!histCommand(history, *input + 4))
+            fprintf(stderr, "usage: hist [count | from-to | -s pattern]\n");
+        return true;
+    }
+    if (!strchr(*input, '!'))
+        return false;
+
+    // Build the expanded line in this buffer, grown as needed
+    static char *buffer = NULL;
+    static size_t cap = 0;
+    size_t w = 0;        // write index into buffer
+    char *r = *input;    // read pointer into input
+    bool changed = false;
+
+    // iterate over every char in input
+    while (*r) {
+        const char *h = NULL;
+        //  !!
+        if (r[0]=='!' && r[1]=='!') {
+            h = getLastHistory(history);
+            if (!h) {
+                fprintf(stderr, "No commands in history\n");
+                return true;  // skip execution
+            }
+            r += 2;  // advance past "!!"
+        }
+
+        // !n
+        else if (r[0]=='!' && isdigit((unsigned char)r[1])) {
+            // read the number
+            int n = 0;
+            char *q = r + 1;
+            while (isdigit((unsigned char)*q)) {
+                n = n * 10 + (*q - '0');
+                q++;
+            }
+            h = getHistory(history, n);
+            if (!h) {
+                fprintf(stderr, "No such command: %d\n", n);
+                return true;
+            }
+            r = q;  // advance past !n
+        }
+
+        // !prefix: latest command starting with prefix. Like bash, a '!'
+        // followed by a blank, '=' or '(' is left alone.
+        else if (r[0]=='!' && r[1] && !isspace((unsigned char)r[1]) &&
+                 r[1] != '=' && r[1] != '(') {
+            char *q = r + 1;
+            while (*q && !isspace((unsigned char)*q))
+                q++;
+            char saved = *q;
+            *q = '\0';
+            long n = searchHistoryPrefix(history, r + 1);
+            h = n ? getHistory(history, n) : NULL;
+            if (!h) {
+                fprintf(stderr, "No such command: %s\n", r);
+                *q = saved;
+                return true;
+            }
+            *q = saved;
+            r = q;  // advance past !prefix
+        }
+
+        // copy the history entry, or everything up to the next '!'
+        bool ok;
+        if (h) {
+            ok = appendExpansion(&buffer, &cap, &w, h, strlen(h));
+            changed = true;
+        }
+        else {
+            char *bang = strchr(r + 1, '!');
+            size_t len = bang ? (size_t)(bang - r) : strlen(r);
+            ok = appendExpansion(&buffer, &cap, &w, r, len);
+            r += len;
+        }
+        if (!ok) {
+            perror("realloc");
+            return true;
+        }
+    }
+    if (!changed)
+        return false;
+
+    // NUL-terminate and hand the expanded line back
+    buffer[w] = '\0';
+    *input = buffer;
+    printf("%s\n", *input);
+
+    //  false -> caller should parse and execute the new input
+    return false;
+}
+
+
+// ——— Events ——————————————————————————————————————————————
+
+// Block SIGCHLD and route it through a signalfd so child state changes
+// become readable events instead of asynchronous handlers.
+void initSignals(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    // a feeder whose reader is gone gets EPIPE instead of killing the shell;
+    // children get the original mask back, SIGPIPE unblocked
+    sigaddset(&mask, SIGPIPE);
+    if (sigprocmask(SIG_BLOCK, &mask, &shell_sigmask) == -1) {
+        DebugMessage("sigprocmask", true);
+        return;
+    }
+    sigdelset(&mask, SIGPIPE);
+    sigchld_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigchld_fd == -1)
+        DebugMessage("signalfd", true);
+}
+
+// Drain pending SIGCHLD events and record every child whose state changed.
+void reapChildren(void) {
+    struct signalfd_siginfo info;
+    while (sigchld_fd != -1 && read(sigchld_fd, &info, sizeof(info)) == sizeof(info))
+        ;
+    updateProcessList(&process_list);
+}
+
+// Sleep on the signalfd until none of the given children is still running,
+// pumping the feeder, if any, meanwhile.
+// Returns the exit status of the last child, as for a pipeline.
+int waitForeground(const pid_t *pids, int n) {
+    for (;;) {
+        reapChildren();
+        pumpActiveFeeder();
+        // a feeder is done when its reader is: it gets EPIPE if it exits
+        bool running = false;
+        for (int i = 0; i < n && !running; i++) {
+            process *p = pids[i] > 0 ? findProcess(pids[i]) : NULL;
+            running = p && p->status == RUNNING;
+        }
+        if (!running)
+            break;
+
+        if (sigchld_fd == -1) {
+            // no signalfd: finish feeding with blocking writes, then
+            // block until any child changes state
+            if (active_feeder) {
+                fcntl(active_feeder->out_fd, F_SETFL, 0);
+                continue;
+            }
+            if (reapChild(0) == -1 && errno != EINTR)
+                break;
+            continue;
+        }
+        struct pollfd pfds[2] = {
+            { sigchld_fd, POLLIN, 0 },
+            { active_feeder ? active_feeder->out_fd : -1, POLLOUT, 0 },
+        };
+        if (poll(pfds, 2, -1) == -1 && errno != EINTR) {
+            DebugMessage("poll", true);
+            return 1;
+        }
+    }
+    process *last = n > 0 && pids[n - 1] > 0 ? findProcess(pids[n - 1]) : NULL;
+    return last ? last->exitCode : 0;
+}
+
+double tvSeconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+long nowNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Record one prompt-to-prompt interval; debug mode prints it as it happens.
+void recordLatency(latency_counter *c, long ns) {
+    if (c->count == 0 || ns < c->min)
+        c->min = ns;
+    if (ns > c->max)
+        c->max = ns;
+    c->last = ns;
+    c->total += ns;
+    c->count++;
+
+    char msg[64];
+    snprintf(msg, sizeof(msg), "latency: %ld us", ns / 1000);
+    DebugMessage(msg, false);
+}
+
+void printLatency(const latency_counter *c) {
+    if (c->count == 0)
+        return;
+    fprintf(stderr, "commands: %ld  latency us: min %ld  avg %ld  max %ld\n",
+            c->count, c->min / 1000, c->total / c->count / 1000, c->max / 1000);
+}
+
+// ——— Feeder ——————————————————————————————————————————————
+
+// "cat file..." can be fed in-shell when it only names regular files,
+// which sendfile() can always copy from. Anything else runs the real cat.
+bool isFeederStage(const cmdLine *pCmdLine) {
+    struct stat st;
+    if (pCmdLine->argCount < 2 || strcmp(pCmdLine->arguments[0], "cat") != 0)
+        return false;
+    for (int i = 1; i < pCmdLine->argCount; i++) {
+        const char *arg = pCmdLine->arguments[i];
+        if (arg[0] == '-' || stat(arg, &st) == -1 || !S_ISREG(st.st_mode))
+            return false;
+    }
+    return true;
+}
+
+// Takes ownership of pCmdLine, in_fd and out_fd, which is made non-blocking.
+// With in_fd -1 the stage's files are copied, otherwise in_fd alone (a
+// utility's output, see runUtility).
+feeder *startFeeder(cmdLine *pCmdLine, int in_fd, int out_fd) {
+    feeder *f = malloc(sizeof(feeder));
+    if (!f) {
+        perror("malloc");
+        if (in_fd != -1)
+            close(in_fd);
+        close(out_fd);
+        return NULL;
+    }
+    f->cmd = pCmdLine;
+    f->next = in_fd == -1 ? 1 : pCmdLine->argCount;
+    f->in_fd = in_fd;
+    f->out_fd = out_fd;
+    f->status = 0;
+    f->wrote = false;
+    f->spill = (spillBuffer){ NULL, 0, 0 };
+    fcntl(out_fd, F_SETFL, O_NONBLOCK);
+    DebugMessage("feeding stage in-shell", false);
+    return f;
+}
+
+// Pump the shell's feeder, if any, and retire it once it is done. Called
+// while waiting for a foreground job and while waiting for input, so a
+// feeder keeps going when its job is stopped or sent to the background.
+void pumpActiveFeeder(void) {
+    if (active_feeder && !pumpFeeder(active_feeder)) {
+        finishFeeder(active_feeder);
+        active_feeder = NULL;
+    }
+}
+
+// Copy as much as the pipe takes right now. Returns false once every file
+// has been copied or the reader went away.
+bool pumpFeeder(feeder *f) {
+    for (;;) {
+        if (f->in_fd == -1) {
+            if (f->next >= f->cmd->argCount)
+                return false;
+            const char *path = f->cmd->arguments[f->next++];
+            if ((f->in_fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+                fprintf(stderr, "cat: %s: %s\n", path, strerror(errno));
+                f->status = 1;
+                continue;
+            }
+        }
+        ssize_t r = copyChunk(f->out_fd, f->in_fd, &f->spill);
+        if (r > 0 && !f->wrote) {
+            f->wrote = true;
+            traceEvent(TRACE_FIRST_BYTE, 0, 0, r, nowNanos());
+        }
+        if (r > 0)
+            continue;
+        if (r == -1 && (errno == EAGAIN || errno == EINTR))
+            return true;
+        if (r == -1) {
+            if (errno != EPIPE)
+                DebugMessage("sendfile", true);
+            return false;
+        }
+        close(f->in_fd);    // end of this file
+        f->in_fd = -1;
+    }
+}
+
+// One sendfile() step, with a read/write copy for descriptors sendfile()
+// rejects (e.g. an O_APPEND file or a pipe to read). Returns like
+// sendfile(). With spill, what a non-blocking out_fd doesn't take of a
+// read is kept there and written by the next call before reading on;
+// without it out_fd must block.
+ssize_t copyChunk(int out_fd, int in_fd, spillBuffer *spill) {
+    if (spill && spill->off < spill->len) {
+        ssize_t w = write(out_fd, spill->data + spill->off, spill->len - spill->off);
+        if (w > 0)
+            spill->off += w;
+        return w;
+    }
+    ssize_t r = sendfile(out_fd, in_fd, NULL, 1 << 20);
+    if (r == -1 && errno == EINVAL) {
+        char stack[1 << 16], *buf = stack;
+        if (spill && !spill->data && !(spill->data = malloc(sizeof(stack))))
+            return -1;
+        if (spill)
+            buf = spill->data;
+        r = read(in_fd, buf, sizeof(stack));
+        for (ssize_t done = 0, w; r > 0 && done < r; done += w)
+            if ((w = write(out_fd, buf + done, r - done)) == -1) {
+                if (!spill || (errno != EAGAIN && errno != EINTR))
+                    return -1;
+                spill->off = done;      // the rest goes out next call
+                spill->len = r;
+                return done ? done : -1;
+            }
+    }
+    return r;
+}
+
+// Closes the pipe (the reader sees EOF) and frees the feeder.
+int finishFeeder(feeder *f) {
+    int status = f->status;
+    if (f->in_fd != -1)
+        close(f->in_fd);
+    close(f->out_fd);
+    freeCmdLines(f->cmd);
+    free(f->spill.data);
+    free(f);
+    return status;
+}
+
+// Foreground "cat file... [> out]" without a pipe: a blocking copy into
+// stdout or the redirection target.
+int catCommand(cmdLine *pCmdLine) {
+    int out_fd = STDOUT_FILENO;
+    if (pCmdLine->outputRedirect &&
+        (out_fd = open(pCmdLine->outputRedirect, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1) {
+        DebugMessage("output redirection open failed", true);
+        return 1;
+    }
+    feeder f = { pCmdLine, 1, -1, out_fd, 0, false };
+    while (pumpFeeder(&f))
+        ;   // blocking descriptor: only EINTR comes back here
+    free(f.spill.data);
+    if (f.in_fd != -1)
+        close(f.in_fd);
+    if (out_fd != STDOUT_FILENO)
+        close(out_fd);
+    return f.status;
+}
+
+// ——— Utilities ———————————————————————————————————————————
+
+static bool writeFully(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(fd, buf, len);
+        if (w == -1 && errno == EINTR)
+            continue;
+        if (w == -1)
+            return false;
+        buf += w;
+        len -= w;
+    }
+    return true;
+}
+
+// Run a utility builtin in the shell, with its output collected in memory
+// and then written to *out_fd (stdout if -1). A pipe to the next stage
+// takes it in one write when it fits in the pipe buffer, so no stage is
+// forked for it; larger output of a foreground line is handed to the
+// feeder, which then owns the pipe (*out_fd becomes -1). Without a feeder
+// to spare it returns false and the caller launches the external command
+// instead; the output is dropped, and kill, the one utility with side
+// effects, writes none. Takes ownership of pCmdLine when it returns true.
+bool runUtility(const builtinEntry *b, cmdLine *pCmdLine, int *out_fd, bool piped, bool foreground,
+                int *status) {
+    char *buf = NULL;
+    size_t len = 0;
+    int in_fd;
+    // utilities don't read stdin, but a missing input file still fails
+    if (pCmdLine->inputRedirect) {
+        if ((in_fd = open(pCmdLine->inputRedirect, O_RDONLY | O_CLOEXEC)) == -1) {
+            DebugMessage("Input redirection open failed", true);
+            freeCmdLines(pCmdLine);
+            *status = 1;
+            return true;
+        }
+        close(in_fd);
+    }
+    FILE *mem = open_memstream(&buf, &len);
+    if (!mem) {
+        perror("open_memstream");
+        freeCmdLines(pCmdLine);
+        *status = 1;
+        return true;
+    }
+    *status = b->run(pCmdLine->argCount, pCmdLine->arguments, mem);
+    fclose(mem);
+
+    int fd = *out_fd == -1 ? STDOUT_FILENO : *out_fd;
+    if (piped && len > (size_t)fcntl(fd, F_GETPIPE_SZ)) {
+        int mem_fd = foreground && !active_feeder ? memfd_create(b->name, MFD_CLOEXEC) : -1;
+        if (mem_fd == -1 || !writeFully(mem_fd, buf, len)) {
+            if (mem_fd != -1)
+                close(mem_fd);
+            free(buf);
+            return false;
+        }
+        free(buf);
+        lseek(mem_fd, 0, SEEK_SET);
+        active_feeder = startFeeder(pCmdLine, mem_fd, *out_fd);
+        *out_fd = -1;
+        return true;
+    }
+    if (len > 0)
+        traceEvent(TRACE_FIRST_BYTE, 0, 0, len, nowNanos());
+    if (len > 0 && !writeFully(fd, buf, len) && errno != EPIPE)
+        DebugMessage("write", true);
+    free(buf);
+    freeCmdLines(pCmdLine);
+    return true;
+}
+
+// ——— Substitution ————————————————————————————————————————
+
+// Run text as a command line, through dispatchCommand like any other, with
+// the shell's stdout pointed at a memfd meanwhile: builtins, utilities and
+// children all write there. A cd inside does not leak out, as if the line
+// ran in a subshell. Returns the output without its trailing newlines in a
+// malloc'd string, or NULL on failure.
+char *captureCommand(const char *text, char cwd[]) {
+    int fd = memfd_create("subst", MFD_CLOEXEC);
+    if (fd == -1) {
+        perror("memfd_create");
+        return NULL;
+    }
+    cmdLine *pCmdLine = parseCachedCmdLines(text);
+    if (pCmdLine && expandSubstitutions(pCmdLine, cwd)) {
+        char inner[PATH_MAX];
+        strcpy(inner, cwd);
+        fflush(stdout);
+        int saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+        dup2(fd, STDOUT_FILENO);
+        dispatchCommand(pCmdLine, inner);
+        fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+        if (strcmp(inner, cwd) != 0 && chdir(cwd) == -1)
+            perror(cwd);
+    }
+    else if (pCmdLine)
+        freeCmdLines(pCmdLine);
+
+    // one read of the whole output
+    off_t len = lseek(fd, 0, SEEK_END);
+    char *out = len >= 0 ? malloc(len + 1) : NULL;
+    ssize_t got = 0;
+    for (ssize_t r = 0; out && got < len; got += r)
+        if ((r = pread(fd, out + got, len - got, got)) <= 0)
+            break;
+    close(fd);
+    if (!out) {
+        perror("capture");
+        return NULL;
+    }
+    while (got > 0 && out[got - 1] == '\n')
+        got--;
+    out[got] = '\0';
+    return out;
+}
+
+// Expand the $(...)s of arguments[num] and split the result into fields on
+// blanks and newlines. Text around a substitution sticks to the field next
+// to it; empty fields are dropped. Returns the number of fields, -1 on error.
+static int expandWord(cmdLine *pCmdLine, int num, char cwd[]) {
+    const char *word = pCmdLine->arguments[num];
+    char *fields = NULL;
+    size_t cap = 0, len = 0;
+    int count = 0;
+    bool open = false;      // a field has begun
+    bool ok = true;
+    for (const char *s = word; *s && ok; ) {
+        if (s[0] != '$' || s[1] != '(') {
+            ok = appendExpansion(&fields, &cap, &len, s++, 1);
+            open = true;
+            continue;
+        }
+        const char *end = substitutionEnd(s + 2);
+        if (!*end) {
+            fprintf(stderr, "unterminated $( in %s\n", word);
+            free(fields);
+            return -1;
+        }
+        char *text = strndup(s + 2, end - s - 2);
+        char *out = text ? captureCommand(text, cwd) : NULL;
+        free(text);
+        if (!out) {
+            free(fields);
+            return -1;
+        }
+        for (const char *o = out; *o && ok; o++) {
+            if (*o != ' ' && *o != '\t' && *o != '\n') {
+                ok = appendExpansion(&fields, &cap, &len, o, 1);
+                open = true;
+            }
+            else if (open) {
+                ok = appendExpansion(&fields, &cap, &len, "", 1);   // ends the field
+                count++;
+                open = false;
+            }
+        }
+        free(out);
+        s = end + 1;
+    }
+    if (ok && open) {
+        ok = appendExpansion(&fields, &cap, &len, "", 1);
+        count++;
+    }
+
+    char **argv = ok ? malloc((count + 1) * sizeof(char *)) : NULL;
+    char *f = fields;
+    for (int i = 0; argv && i < count; i++, f += strlen(f) + 1)
+        argv[i] = f;
+    ok = argv && spliceCmdArg(pCmdLine, num, argv, count);
+    if (!ok)
+        perror("substitution");
+    free(argv);
+    free(fields);
+    return ok ? count : -1;
+}
+
+// Replace every $(cmd) in the arguments of each stage by cmd's output, split
+// into arguments. Inner substitutions run first, at any depth. Returns false,
+// and the line should be dropped, on an error or if a stage is left without
+// a command.
+bool expandSubstitutions(cmdLine *pCmdLine, char cwd[]) {
+    for (cmdLine *c = pCmdLine; c; c = c->next) {
+        for (int i = 0; i < c->argCount; i++) {
+            if (!strstr(c->arguments[i], "$("))
+                continue;
+            int n = expandWord(c, i, cwd);
+            if (n < 0)
+                return false;
+            i += n - 1;     // the fields are not expanded again
+        }
+        if (c->argCount == 0)
+            return false;
+    }
+    return true;
+}
+
+// ——— Parallel ————————————————————————————————————————————
+
+// word with every {} in it replaced by item, NULL without memory.
+static char *fillPlaceholders(const char *word, const char *item) {
+    size_t count = 0, ilen = strlen(item);
+    for (const char *s = word; (s = strstr(s, "{}")); s += 2)
+        count++;
+    char *filled = malloc(strlen(word) + count * ilen + 1);
+    if (!filled)
+        return NULL;
+    char *w = filled;
+    for (const char *s = word, *at; ; s = at + 2) {
+        if (!(at = strstr(s, "{}"))) {
+            strcpy(w, s);
+            return filled;
+        }
+        memcpy(w, s, at - s);
+        w += at - s;
+        memcpy(w, item, ilen);
+        w += ilen;
+    }
+}
+
+// Launch one job: the template line with every {} replaced by item, also
+// inside a word (x{}.gz).
+static pid_t startParallelJob(const char *tmpl, const char *item, parallelSlot *slot) {
+    cmdLine *c = parseCachedCmdLines(tmpl);    // the {} replacements copy on write
+    if (!c)
+        return -1;
+    for (int i = 0; i < c->argCount; i++) {
+        if (strcmp(c->arguments[i], "{}") == 0) {
+            replaceCmdArg(c, i, item);
+            continue;
+        }
+        if (!strstr(c->arguments[i], "{}"))
+            continue;
+        char *filled = fillPlaceholders(c->arguments[i], item);
+        if (!filled) {
+            perror("malloc");
+            freeCmdLines(c);
+            return -1;
+        }
+        replaceCmdArg(c, i, filled);
+        free(filled);
+    }
+    int out_fd = memfd_create("parallel", MFD_CLOEXEC);
+    if (out_fd == -1) {
+        perror("memfd_create");
+        freeCmdLines(c);
+        return -1;
+    }
+    pid_t pid = forkAndExec(c->arguments[0], c->arguments, -1, out_fd, 0, NULL);
+    if (pid <= 0) {
+        close(out_fd);
+        freeCmdLines(c);
+        return -1;
+    }
+    addProcess(&process_list, c, pid);
+    DebugChild(pid, c->arguments[0]);
+    freeCmdLines(c);
+    slot->pid = pid;
+    slot->out_fd = out_fd;
+    return pid;
+}
+
+// Read one item per line from fd into a buffer the items point into.
+static char *readParallelItems(int fd, const char ***items, int *n) {
+    size_t len = 0, cap = 4096;
+    char *buf = malloc(cap + 1);
+    for (ssize_t r; buf; len += r) {
+        if (len == cap) {
+            char *grown = realloc(buf, (cap *= 2) + 1);
+            if (!grown) { free(buf); buf = NULL; break; }
+            buf = grown;
+        }
+        if ((r = read(fd, buf + len, cap - len)) <= 0) {
+            if (r == -1 && errno == EINTR) { r = 0; continue; }
+            break;
+        }
+    }
+    if (!buf) {
+        perror("malloc");
+        return NULL;
+    }
+    buf[len] = '\0';
+    int cap_items = 16;
+    *items = malloc(cap_items * sizeof(char *));
+    *n = 0;
+    for (char *line = buf, *end; *items && *line; line = end) {
+        end = line + strcspn(line, "\n");
+        if (*end)
+            *end++ = '\0';
+        if (!*line)
+            continue;
+        if (*n == cap_items) {
+            const char **grown = realloc(*items, (cap_items *= 2) * sizeof(char *));
+            if (!grown) { free(*items); *items = NULL; break; }
+            *items = grown;
+        }
+        (*items)[(*n)++] = line;
+    }
+    if (!*items) {
+        perror("malloc");
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+// parallel [-j K] cmd [args] [::: item...]
+// Runs cmd once per item with at most K children in flight (default: the
+// online CPUs), {} in args standing for the item, alone or inside a word
+// (appended when absent).
+// Items come after ::: or, one per line, from stdin. A new job starts as
+// soon as SIGCHLD reports one done; each job's output is written whole.
+// Returns the number of failed jobs, capped at 101 like GNU parallel.
+int parallelCommand(cmdLine *pCmdLine) {
+    char * const *args = pCmdLine->arguments;
+    int argc = pCmdLine->argCount;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int first = 1;
+    if (first < argc && strncmp(args[first], "-j", 2) == 0) {
+        const char *k = args[first][2] ? args[first] + 2 : args[++first];
+        jobs = k ? atol(k) : 0;
+        first++;
+    }
+    int sep = first;
+    while (sep < argc && strcmp(args[sep], ":::") != 0)
+        sep++;
+    if (jobs < 1 || sep == first) {
+        fprintf(stderr, "usage: parallel [-j jobs] cmd [args] [::: item...]\n");
+        return 2;
+    }
+
+    // command template: the arguments before :::, re-parsed for each job
+    size_t tlen = sizeof(" {}");
+    bool placeholder = false;
+    for (int i = first; i < sep; i++) {
+        tlen += strlen(args[i]) + 1;
+        placeholder |= strstr(args[i], "{}") != NULL;
+    }
+    char *tmpl = malloc(tlen);
+    if (!tmpl) {
+        perror("malloc");
+        return 1;
+    }
+    char *t = tmpl;
+    for (int i = first; i < sep; i++)
+        t += sprintf(t, i > first ? " %s" : "%s", args[i]);
+    if (!placeholder)
+        strcpy(t, " {}");
+
+    const char **items = (const char **) args + sep + 1;
+    int nitems = argc - sep - 1;
+    char *itemBuf = NULL;
+    int out = STDOUT_FILENO, in = STDIN_FILENO;
+    if (sep == argc) {
+        if (hasHereText(pCmdLine) && (in = openHereText(pCmdLine)) == -1) {
+            free(tmpl);
+            return 1;
+        }
+        if (pCmdLine->inputRedirect &&
+            (in = open(pCmdLine->inputRedirect, O_RDONLY | O_CLOEXEC)) == -1) {
+            DebugMessage("Input redirection open failed", true);
+            free(tmpl);
+            return 1;
+        }
+        itemBuf = readParallelItems(in, &items, &nitems);
+        if (in != STDIN_FILENO)
+            close(in);
+    }
+    if (pCmdLine->outputRedirect &&
+        (out = open(pCmdLine->outputRedirect, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1)
+        DebugMessage("output redirection open failed", true);
+    if (jobs > nitems)
+        jobs = nitems;
+    parallelSlot *slots = calloc(jobs ? jobs : 1, sizeof(parallelSlot));
+    if ((sep == argc && !itemBuf) || out == -1 || !slots) {
+        if (!slots)
+            perror("calloc");
+        free(slots);
+        free(itemBuf);
+        free(tmpl);
+        return 1;
+    }
+
+    int next = 0, running = 0, failed = 0;
+    while (next < nitems || running) {
+        for (int s = 0; s < jobs && next < nitems; s++) {
+            if (slots[s].pid)
+                continue;
+            if (startParallelJob(tmpl, items[next++], &slots[s]) > 0)
+                running++;
+            else
+                failed++;
+        }
+        if (!running)
+            continue;
+
+        reapChildren();
+        bool freed = false;
+        for (int s = 0; s < jobs; s++) {
+            process *p = slots[s].pid ? findProcess(slots[s].pid) : NULL;
+            if (!slots[s].pid || (p && p->status != TERMINATED))
+                continue;
+            // done: write its output whole, in completion order
+            lseek(slots[s].out_fd, 0, SEEK_SET);
+            while (copyChunk(out, slots[s].out_fd, NULL) > 0)
+                ;
+            close(slots[s].out_fd);
+            if (!p || p->exitCode != 0)
+                failed++;
+            slots[s].pid = 0;
+            running--;
+            freed = true;
+        }
+        if (freed)
+            continue;
+
+        if (sigchld_fd == -1) {
+            reapChild(0);
+            continue;
+        }
+        struct pollfd pfd = { sigchld_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+            DebugMessage("poll", true);
+            break;
+        }
+    }
+
+    if (out != STDOUT_FILENO)
+        close(out);
+    if (itemBuf)
+        free(items);
+    free(itemBuf);
+    free(slots);
+    free(tmpl);
+    return failed > 101 ? 101 : failed;
+}
+
+// ——— Input ———————————————————————————————————————————————
+
+// Scripts are mapped rather than read, -c strings are used in place and
+// everything else is read from stdin in large blocks.
+bool openInput(inputSource *in, const shellOptions *opts) {
+    memset(in, 0, sizeof(*in));
+    in->fd = -1;
+    if (opts->command) {
+        in->text = opts->command;
+        in->textLen = strlen(opts->command);
+        return true;
+    }
+    if (!opts->script) {
+        in->fd = STDIN_FILENO;
+        in->cap = isatty(STDIN_FILENO) ? 4096 : 1 << 16;
+        in->buf = malloc(in->cap);
+        return in->buf != NULL;
+    }
+
+    int fd = open(opts->script, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror(opts->script);
+        if (fd != -1)
+            close(fd);
+        return false;
+    }
+    if (st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("mmap");
+            close(fd);
+            return false;
+        }
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        in->text = map;
+        in->textLen = in->mapLen = st.st_size;
+    }
+    close(fd);
+    return true;
+}
+
+void closeInput(inputSource *in) {
+    if (in->mapLen)
+        munmap((void *)in->text, in->mapLen);
+    free(in->buf);
+    free(in->line);
+    memset(in, 0, sizeof(*in));
+}
+
+// Next line from an in-memory text, copied out so it can be NUL-terminated.
+static char *readTextLine(inputSource *in) {
+    if (in->textPos >= in->textLen)
+        return NULL;
+    const char *start = in->text + in->textPos;
+    const char *nl = memchr(start, '\n', in->textLen - in->textPos);
+    size_t len = nl ? (size_t)(nl - start) : in->textLen - in->textPos;
+    if (len + 1 > in->lineCap) {
+        size_t cap = in->lineCap ? in->lineCap : 256;
+        while (cap < len + 1)
+            cap *= 2;
+        char *line = realloc(in->line, cap);
+        if (!line)
+            return NULL;
+        in->line = line;
+        in->lineCap = cap;
+    }
+    memcpy(in->line, start, len);
+    in->line[len] = '\0';
+    in->textPos += len + (nl ? 1 : 0);
+    return in->line;
+}
+
+// Returns the next line without its newline, or NULL at end of input. The
+// line stays valid until the next call. While no complete line is buffered
+// stdin is polled together with the signalfd, so background children are
+// reaped the moment they change state. Lines may be of any length.
+char *readInputLine(inputSource *in) {
+    if (in->fd == -1)
+        return readTextLine(in);
+
+    for (;;) {
+        char *nl = memchr(in->buf + in->start, '\n', in->end - in->start);
+        if (nl || (in->eof && in->end > in->start)) {
+            char *line = in->buf + in->start;
+            if (nl) {
+                *nl = '\0';
+                in->start = nl - in->buf + 1;
+            }
+            else {
+                // last line without a newline: make room for the terminator
+                if (in->end == in->cap) {
+                    memmove(in->buf, line, in->end - in->start);
+                    in->end -= in->start;
+                    in->start = 0;
+                    line = in->buf;
+                }
+                in->buf[in->end] = '\0';
+                in->start = in->end;
+            }
+            return line;
+        }
+        if (in->eof)
+            return NULL;
+
+        // make room at the back of the buffer, growing it for long lines
+        memmove(in->buf, in->buf + in->start, in->end - in->start);
+        in->end -= in->start;
+        in->start = 0;
+        if (in->end == in->cap) {
+            char *buf = realloc(in->buf, in->cap * 2);
+            if (!buf) {
+                perror("realloc");
+                return NULL;
+            }
+            in->buf = buf;
+            in->cap *= 2;
+        }
+
+        // a feeder whose job went to the background (^Z, bg) is kept
+        // going from here; poll skips the descriptors left at -1
+        struct pollfd pfds[3] = {
+            { in->fd,     POLLIN, 0 },
+            { sigchld_fd, POLLIN, 0 },
+            { active_feeder ? active_feeder->out_fd : -1, POLLOUT, 0 },
+        };
+        if (poll(pfds, 3, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            DebugMessage("poll", true);
+            return NULL;
+        }
+        if (pfds[1].revents & POLLIN)
+            reapChildren();
+        if (pfds[2].revents)
+            pumpActiveFeeder();
+        if (pfds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t r = read(in->fd, in->buf + in->end, in->cap - in->end);
+            if (r > 0)
+                in->end += r;
+            else if (r == 0 || errno != EINTR)
+                in->eof = true;
+        }
+    }
+}
+
+// Read the body of every <<WORD here-document of the line from the input,
+// up to a line that is exactly WORD. End of input also ends a body, with a
+// warning. Returns false if a body could not be stored.
+bool readHereDocs(cmdLine *pCmdLine, inputSource *in, bool interactive) {
+    for (cmdLine *c = pCmdLine; c; c = c->next) {
+        if (!c->hereDelim)
+            continue;
+        char *body = NULL;
+        size_t len = 0, cap = 0;
+        char *line;
+        for (;;) {
+            if (interactive) {
+                fputs("> ", stdout);
+                fflush(stdout);
+            }
+            if (!(line = readInputLine(in))) {
+                fprintf(stderr, "here-document ended by end of input (wanted %s)\n", c->hereDelim);
+                break;
+            }
+            if (strcmp(line, c->hereDelim) == 0)
+                break;
+            size_t n = strlen(line);
+            if (len + n + 2 > cap) {
+                cap = cap ? cap : 256;
+                while (len + n + 2 > cap)
+                    cap *= 2;
+                char *grown = realloc(body, cap);
+                if (!grown) {
+                    perror("realloc");
+                    free(body);
+                    return false;
+                }
+                body = grown;
+            }
+            memcpy(body + len, line, n);
+            len += n;
+            body[len++] = '\n';
+            body[len] = '\0';
+        }
+        bool ok = setHereDoc(c, body ? body : "");
+        free(body);
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+// ——— Helpers —————————————————————————————————————————————
+
+// Print an error and return false if a pipe end is also redirected:
+// only the first stage may read a file and only the last may write one.
+bool validateNoRedirectConflict(cmdLine *pipeline) {
+    for (cmdLine *c = pipeline; c; c = c->next) {
+        if ((c != pipeline && (c->inputRedirect || hasHereText(c))) ||
+            (c->next && c->outputRedirect)) {
+            DebugMessage("can't mix pipe and I/O redirect", false);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool hasHereText(const cmdLine *pCmdLine) {
+    return pCmdLine->hereText || pCmdLine->hereDelim;
+}
+
+// stdin for a <<< here-string or << here-document: the text in a sealed
+// memfd, rewound for the child. Nothing touches the filesystem and no
+// process feeds it. Returns -1 on failure.
+int openHereText(const cmdLine *pCmdLine) {
+    const char *text = pCmdLine->hereText ? pCmdLine->hereText : "";
+    int fd = memfd_create("here", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1) {
+        DebugMessage("memfd_create", true);
+        return -1;
+    }
+    // a here-string gets the newline its word lacks, a document has its own
+    if (!writeFully(fd, text, strlen(text)) ||
+        (!pCmdLine->hereDelim && !writeFully(fd, "\n", 1)) ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1 ||
+        lseek(fd, 0, SEEK_SET) == -1) {
+        DebugMessage("here text", true);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Launch a child with its stdin/out redirected to the given fds.
+// If in_fd or out_fd is -1, that side isn’t redirected.
+// pgid and sched are as for launchSpec.
+int forkAndExec(char *path, char *const argv[],
+                         int in_fd, int out_fd, pid_t pgid,
+                         const launchSched *sched)
+{
+    const char *resolved = lookupCommand(path);
+    launchSpec spec = {
+        .path = resolved ? resolved : path,
+        .argv = argv,
+        .in_fd = in_fd,
+        .out_fd = out_fd,
+        .pgid = pgid,
+        .sched = sched,
+    };
+    return launchTraced(&spec);
+}
+
+// launchProcess between TRACE_LAUNCH and TRACE_EXEC events; the time in
+// between is the spawn latency.
+pid_t launchTraced(const launchSpec *spec) {
+    long start = nowNanos();
+    traceEvent(TRACE_LAUNCH, 0, 0, 0, start);
+    pid_t pid = launchProcess(spec);
+    int err = errno;
+    long end = nowNanos();
+    traceEvent(TRACE_EXEC, pid > 0 ? pid : 0, 0, pid > 0 ? 0 : err, end);
+    if (pid > 0)
+        traceSample(TRACE_SPAWN_LATENCY, end - start);
+    errno = err;
+    return pid;
+}
+
+// Apply the pipebuf setting to a new pipe; -d reports the size it got.
+void sizePipe(int fd) {
+    if (settings.pipebuf && fcntl(fd, F_SETPIPE_SZ, settings.pipebuf) == -1)
+        DebugMessage("F_SETPIPE_SZ", true);
+    if (debug) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "pipe buffer: %d bytes", fcntl(fd, F_GETPIPE_SZ));
+        DebugMessage(msg, false);
+    }
+}
+
+// "0-3,6" -> cpus; false if malformed or out of range.
+static bool parseCpuList(const char *list, cpu_set_t *cpus) {
+    CPU_ZERO(cpus);
+    for (const char *s = list; *s; ) {
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+        if (end == s || lo < 0)
+            return false;
+        if (*end == '-') {
+            s = end + 1;
+            hi = strtol(s, &end, 10);
+            if (end == s || hi < lo)
+                return false;
+        }
+        if (hi >= CPU_SETSIZE)
+            return false;
+        for (long cpu = lo; cpu <= hi; cpu++)
+            CPU_SET(cpu, cpus);
+        if (*end == ',')
+            end++;
+        else if (*end)
+            return false;
+        s = end;
+    }
+    return CPU_COUNT(cpus) > 0;
+}
+
+static bool parsePolicy(const char *name, int *policy) {
+    static const struct { const char *name; int policy; } policies[] = {
+        { "other", SCHED_OTHER }, { "batch", SCHED_BATCH }, { "idle", SCHED_IDLE },
+        { "fifo", SCHED_FIFO }, { "rr", SCHED_RR },
+    };
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+        if (strcmp(name, policies[i].name) == 0) {
+            *policy = policies[i].policy;
+            return true;
+        }
+    return false;
+}
+
+// Strip leading launch prefixes off argv into sched, any number of:
+//   pin CPUS          affinity, e.g. "2-5" or "0,2,4"
+//   nice [-n N | -N]  add N (default 10) to the nice value
+//   sched POLICY [P]  other|batch|idle, or fifo|rr at priority P (default 1)
+// Returns 1 if there were prefixes, 0 if none, -1 after a usage error.
+// A bare "nice" with nothing to run is left to the external command.
+int parseLaunchPrefixes(cmdLine *pCmdLine, launchSched *sched) {
+    char * const *argv = pCmdLine->arguments;
+    int argc = pCmdLine->argCount, i = 0;
+    memset(sched, 0, sizeof(*sched));
+    for (;;) {
+        const char *word = argv[i];
+        if (strcmp(word, "pin") == 0) {
+            if (i + 2 >= argc || !parseCpuList(argv[i + 1], &sched->cpus)) {
+                fprintf(stderr, "usage: pin CPUS cmd\n");
+                return -1;
+            }
+            sched->pin = true;
+            i += 2;
+        }
+        else if (strcmp(word, "nice") == 0 && i + 1 < argc) {
+            sched->renice = true;
+            sched->niceAdjust = 10;
+            const char *adj = argv[i + 1];
+            if (strcmp(adj, "-n") == 0 && i + 3 >= argc) {
+                fprintf(stderr, "usage: nice [-n N] cmd\n");
+                return -1;
+            }
+            if (strcmp(adj, "-n") == 0) {
+                sched->niceAdjust = atoi(argv[i + 2]);
+                i += 2;
+            }
+            else if (adj[0] == '-' && (isdigit((unsigned char)adj[1]) ||
+                                       (adj[1] == '-' && isdigit((unsigned char)adj[2])))) {
+                sched->niceAdjust = atoi(adj + 1);
+                i++;
+            }
+            if (++i >= argc) {
+                fprintf(stderr, "usage: nice [-n N] cmd\n");
+                return -1;
+            }
+        }
+        else if (strcmp(word, "sched") == 0) {
+            if (i + 2 >= argc || !parsePolicy(argv[i + 1], &sched->policy)) {
+                fprintf(stderr, "usage: sched other|batch|idle|fifo|rr [priority] cmd\n");
+                return -1;
+            }
+            sched->setPolicy = true;
+            i += 2;
+            bool realtime = sched->policy == SCHED_FIFO || sched->policy == SCHED_RR;
+            sched->priority = realtime ? 1 : 0;
+            if (realtime && isdigit((unsigned char)argv[i][0]) && i + 1 < argc)
+                sched->priority = atoi(argv[i++]);
+        }
+        else
+            break;
+    }
+    if (i == 0)
+        return 0;
+    pCmdLine->arguments += i;   // argv lives in the line's arena
+    pCmdLine->argCount -= i;
+    return 1;
+}
+
+// Pin a pipeline stage to the next CPU of the shell's allowed set. The
+// round-robin carries over between pipelines, so short lines don't all
+// start on the same CPU.
+void spreadStage(launchSched *sched) {
+    static unsigned next;
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+        return;
+    int want = next++ % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &allowed) && want-- == 0) {
+            CPU_ZERO(&sched->cpus);
+            CPU_SET(cpu, &sched->cpus);
+            sched->pin = true;
+            return;
+        }
+}
+
+void DebugMessage(char *message, bool sysError){
+    if(debug){
+        if (sysError)
+            perror(message);
+        else
+            fprintf(stderr, "%s\n", message);
+    }
+}
+
+void DebugChild(int pid, char *cmd) {
+    char msg[100];
+    snprintf(msg, sizeof(msg), "%s%d", "PID: ", pid);
+    DebugMessage(msg, false);
+    snprintf(msg, sizeof(msg), "%s%s", "Command: ", cmd);
+    DebugMessage(msg, false);
 }
\ No newline at end of file
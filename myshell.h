@@ -0,0 +1,319 @@
+// Shell state and entry points shared by myshell.c and the bench harnesses,
+// which link myshell.c built with -DMYSHELL_NO_MAIN.
+#include <stdio.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include "LineParser.h"
+#include "launch.h"
+#include "zygote.h"
+#include "cmdhash.h"
+#include "histfile.h"
+#include "histindex.h"
+#include "builtins.h"
+#include "trace.h"
+
+#define TERMINATED  -1
+#define RUNNING 1
+#define SUSPENDED 0
+#define HISTLEN 1000   // default history capacity, see -H and MYSHELL_HISTSIZE
+
+typedef enum {
+    CMD_QUIT,
+    CMD_CD,
+    CMD_HALT,
+    CMD_WAKEUP,
+    CMD_ICE,
+    CMD_PROCS,
+    CMD_HASH,
+    CMD_CAT,
+    CMD_PARALLEL,
+    CMD_JOBS,
+    CMD_FG,
+    CMD_BG,
+    CMD_TIME,
+    CMD_SET,
+    CMD_STATS,
+    CMD_UTILITY,    // in-process utility, see builtinEntry.run
+    CMD_EXECUTE
+} Command;
+
+// Builtin registry entry. Utilities (echo, test, ...) carry a handler and
+// run in the shell even as pipeline stages; the rest are dispatched on cmd.
+typedef struct {
+    const char *name;
+    Command cmd;
+    utilityFn run;      // NULL unless cmd is CMD_UTILITY
+} builtinEntry;
+
+// A job's command as typed, its words joined by spaces and cut to
+// JOB_TEXT_MAX bytes. Equal texts are interned: the stages of a repeated
+// command share one copy, freed with its last reference.
+#define JOB_TEXT_MAX 80
+typedef struct commandText {
+        struct commandText *next;   // hash chain
+        unsigned hash;
+        int refs;
+        char text[];
+} commandText;
+
+// The resource figures of a reaped child worth keeping from its rusage.
+typedef struct {
+        long utime;     // user CPU, microseconds
+        long stime;     // system CPU, microseconds
+        long maxrss;    // kilobytes
+        int nvcsw;      // voluntary context switches
+        int nivcsw;     // involuntary ones
+} jobUsage;
+
+typedef struct process{
+        commandText *cmd;   // interned; the parse tree is freed at launch
+        pid_t pid;
+        int status; 
+        int exitCode;   // exit status, 128+signal if killed or stopped
+        int job;        // job number shared by a line's stages, 0 for none
+        pid_t pgid;     // the job's process group, 0 if in the shell's
+        jobUsage usage; // from wait4
+        long started;   // nowNanos() at launch
+        long ended;     // nowNanos() when reaped, 0 while it runs
+        struct process *next;   // ordered view, newest first; free list link
+        struct process *prev;
+        struct process *jobNext;    // next stage of the same job, in launch order
+} process;
+
+// A job's stages and how many are in each state, updated as they change
+// so that no job query or signal walks the whole process table.
+typedef struct {
+        process *first;     // stages still in the table, in launch order
+        process *last;
+        pid_t pgid;
+        int members;
+        int running;
+        int stopped;
+} jobRecord;
+
+// Records are carved from chunks of PROCESS_CHUNK and recycled through a
+// free list, so a job costs one slab slot instead of a malloc'd record.
+#define PROCESS_CHUNK 256
+typedef struct processChunk {
+        struct processChunk *next;
+        process records[PROCESS_CHUNK];
+} processChunk;
+
+// Job table: records in an ordered list for display, indexed by an
+// open-addressing hash on pid so every status update is a single probe.
+typedef struct {
+    process *head;
+    process **slots;    // NULL = empty, &tombstone = deleted
+    int cap;            // power of two
+    int used;           // live entries plus tombstones
+    int count;          // live entries
+    jobRecord *jobs;    // indexed by job number
+    int jobCap;
+    int lastJob;        // highest job number with stages in the table
+    processChunk *chunks;
+    int chunkCount;
+    process *free;      // recycled records
+    commandText **texts;    // interned command texts, chained
+    int textCap;        // power of two, 0 until the first job
+    int textCount;
+    size_t textBytes;
+} process_table;
+
+// Fixed-capacity ring of entries whose strings live back to back in one
+// slab. Entries are evicted oldest first, so the live strings always form
+// one contiguous run of the slab; offsets are logical (slab index + base)
+// so compacting the run to the front only moves bytes and bumps base.
+typedef struct {
+    size_t *offsets;    // ring of logical offsets, oldest at first
+    int capacity;
+    int first;
+    int count;
+    long total;         // entries ever added: entry n is the n-th added
+    char *slab;
+    size_t base;        // logical offset of slab[0]
+    size_t used;        // logical end of the last string
+    size_t slabCap;
+    histFile *file;     // shared on-disk history; replaces the ring when set
+    histIndex *index;   // search index, built lazily for a history file
+    long indexFloor;    // oldest entry when the index was last rebuilt
+} history_list;
+
+// where command lines come from: stdin/a descriptor read in large blocks,
+// or an in-memory text (mmap'd script file, -c string)
+typedef struct {
+    int fd;              // -1 for in-memory text
+    const char *text;
+    size_t textLen;
+    size_t textPos;
+    char *buf;           // block buffer for fd input, grows for long lines
+    size_t start, end, cap;
+    bool eof;
+    char *line;          // NUL-terminated copy of a line taken from text
+    size_t lineCap;
+    size_t mapLen;       // non-zero if text is a mapping to unmap
+} inputSource;
+
+typedef struct {
+    bool debug;
+    launchBackend backend;
+    const char *command;     // -c string
+    const char *script;      // script file to run
+    int histSize;            // history capacity
+    const char *histFile;    // shared history file, NULL for none
+} shellOptions;
+
+// Bytes the read/write copy read but a non-blocking pipe didn't take,
+// written before anything else is read.
+typedef struct {
+    char *data;         // allocated on first use
+    size_t off, len;    // data[off..len) is still to be written
+} spillBuffer;
+
+// In-shell "cat file..." stage: sendfile() copies the files into the
+// pipe (or stdout) in the kernel, without a cat process or a user copy.
+typedef struct {
+    cmdLine *cmd;       // the cat stage, file names in arguments[1..]
+    int next;           // next argument to open
+    int in_fd;          // file being copied, -1 between files
+    int out_fd;         // non-blocking pipe write end owned by the feeder
+    int status;         // 1 if a file could not be opened
+    bool wrote;         // the first chunk went out (traced)
+    spillBuffer spill;  // read/write copy left over from a full pipe
+} feeder;
+
+// a running job of "parallel": its stdout is kept in a memfd and written
+// out in one piece when the job ends, so outputs never interleave
+typedef struct {
+    pid_t pid;          // 0 for a free slot
+    int out_fd;
+} parallelSlot;
+
+// run-time settings changed with the set builtin
+typedef struct {
+    bool spread;        // pin pipeline stages to distinct CPUs
+    int pipebuf;        // F_SETPIPE_SZ for the pipes of pipelines, 0 for the default
+} shellSettings;
+
+// prompt-to-prompt latency of dispatched commands, in nanoseconds
+typedef struct {
+    long count;
+    long last;
+    long min;
+    long max;
+    long total;
+} latency_counter;
+
+extern bool debug;
+extern process_table process_list;
+extern int sigchld_fd;          // signalfd delivering SIGCHLD, polled with stdin
+extern sigset_t shell_sigmask;  // mask to restore in children before exec
+extern latency_counter latency;
+extern feeder *active_feeder;   // feeder pumped while waiting for a job or for input
+extern bool job_control;        // interactive: jobs get their own groups and the terminal
+extern pid_t shell_pgid;
+extern shellSettings settings;
+
+// USer Commands
+int sigCommand(const char *name, const char *pidStr, int sig);
+int cdCommand(const char *path, char *cwd);
+void hashCommand(cmdLine *pCmdLine);
+int parallelCommand(cmdLine *pCmdLine);
+int jobsCommand(void);
+int fgCommand(const char *spec, bool foreground);
+int timeCommand(cmdLine *pCmdLine, char cwd[]);
+int setCommand(cmdLine *pCmdLine);
+int statsCommand(cmdLine *pCmdLine);
+void printLineCache(FILE *out);
+int killUtility(int argc, char *const argv[], FILE *out);
+
+// Executers
+int dispatchCommand(cmdLine *pCmdLine, char cwd[]);
+int execute(cmdLine *pCmdLine);
+int forkAndExec(char *path, char *const argv[], int in_fd, int out_fd, pid_t pgid,
+                const launchSched *sched);
+int parseLaunchPrefixes(cmdLine *pCmdLine, launchSched *sched);
+bool runUtility(const builtinEntry *b, cmdLine *pCmdLine, int *out_fd, bool piped, bool foreground,
+                int *status);
+void spreadStage(launchSched *sched);
+void sizePipe(int fd);
+pid_t launchTraced(const launchSpec *spec);
+
+// Process
+process *addProcess(process_table *plist, const cmdLine *cmd, pid_t pid);
+void printProcessList(process_table *plist);
+void freeProcessList(process_table *plist);
+void updateProcessList(process_table *plist);
+pid_t reapChild(int options);
+void printUsage(FILE *out, const process *p);
+void printJobFootprint(FILE *out, const process_table *plist);
+void updateProcessStatus(process_table *plist, int pid, int status);
+void removeProcess(process_table *plist, process *cur);
+void removeTerminatedProcesses(process_table *plist);
+process *findProcess(pid_t pid);
+
+// Jobs
+void initJobControl(void);
+void restoreTerminal(void);
+int newJobNumber(void);
+int findJob(const char *spec);
+jobRecord *findJobRecord(int job);
+void setJob(process *p, int job, pid_t pgid);
+int jobState(int job, int *members);
+void markJob(int job, pid_t pid, int status);
+void printJobCommand(int job);
+int waitForegroundJob(int job, pid_t pgid, const pid_t *pids, int n);
+int signalJob(int job, int sig);
+
+// History
+bool initHistory(history_list *h, int capacity, const char *path);
+void freeHistory(history_list *h);
+void addHistory(history_list *h, const char *cmd);
+void printHistory(const history_list *h, long from, long to);
+bool histCommand(history_list *h, const char *args);
+long searchHistoryPrefix(history_list *h, const char *prefix);
+long searchHistory(history_list *h, const char *pattern);
+const char *getHistory(const history_list *h, int n);
+const char *getLastHistory(const history_list *h);
+bool expandHistoryLine(history_list *history, char **input);
+
+// Events
+void initSignals(void);
+void reapChildren(void);
+int waitForeground(const pid_t *pids, int n);
+long nowNanos(void);
+double tvSeconds(struct timeval tv);
+void recordLatency(latency_counter *c, long ns);
+void printLatency(const latency_counter *c);
+
+// Feeder
+bool isFeederStage(const cmdLine *pCmdLine);
+feeder *startFeeder(cmdLine *pCmdLine, int in_fd, int out_fd);
+bool pumpFeeder(feeder *f);
+void pumpActiveFeeder(void);
+int finishFeeder(feeder *f);
+int catCommand(cmdLine *pCmdLine);
+ssize_t copyChunk(int out_fd, int in_fd, spillBuffer *spill);
+
+// Substitution
+char *captureCommand(const char *text, char cwd[]);
+bool expandSubstitutions(cmdLine *pCmdLine, char cwd[]);
+
+// Input
+bool openInput(inputSource *in, const shellOptions *opts);
+char *readInputLine(inputSource *in);
+bool readHereDocs(cmdLine *pCmdLine, inputSource *in, bool interactive);
+void closeInput(inputSource *in);
+
+// Helpers 
+int runPipeline(cmdLine *left);
+bool parseOptions(int argc, char **argv, shellOptions *opts);
+Command getCommand(const char *cmd);
+const builtinEntry *findBuiltin(const char *name);
+void DebugMessage(char *message, bool sysError);
+bool validateNoRedirectConflict(cmdLine *pipeline);
+bool hasHereText(const cmdLine *pCmdLine);
+int openHereText(const cmdLine *pCmdLine);
+void DebugChild(int pid, char *cmd);
@@ -0,0 +1,26 @@
+#!/bin/sh
+# The in-shell cat must not drop bytes a non-blocking pipe didn't take.
+# /proc/PID/environ is a regular file sendfile() rejects, so it takes the
+# read/write copy; 1 MB of environment is far more than the pipe holds,
+# and a reader taking 1000 bytes at a time leaves the pipe part full.
+cd "$(dirname "$0")/.." || exit 1
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+printf '#!/bin/sh\nsleep 1\nexec dd bs=1000 status=none\n' > "$dir/slow"
+chmod +x "$dir/slow"
+big=$(head -c 100000 /dev/zero | tr '\0' x)
+env V0=$big V1=$big V2=$big V3=$big V4=$big V5=$big V6=$big V7=$big \
+    V8=$big V9=$big sleep 30 &
+pid=$!
+sleep 0.2
+cat /proc/$pid/environ > "$dir/expected"
+./myshell -c "cat /proc/$pid/environ | $dir/slow > $dir/out" 2>/dev/null
+kill $pid
+
+if cmp -s "$dir/expected" "$dir/out"; then
+    echo "feeder: ok"
+    exit 0
+fi
+echo "feeder: output differs from /proc/$pid/environ"
+exit 1
@@ -0,0 +1,24 @@
+#!/bin/sh
+# kill must reject targets that are not a pid above 0 or a job: kill(0)
+# would signal the shell's own process group.
+cd "$(dirname "$0")/.." || exit 1
+fail=0
+
+for target in foo 0 12x; do
+    err=$(./myshell -c "kill $target" 2>&1 >/dev/null)
+    st=$?
+    case $err in
+    "kill: $target: arguments must be process or job IDs"*) ;;
+    *) echo "kill $target: unexpected message: $err"; fail=1 ;;
+    esac
+    [ $st -eq 1 ] || { echo "kill $target: status $st, expected 1"; fail=1; }
+done
+
+sleep 30 &
+pid=$!
+./myshell -c "kill $pid" 2>/dev/null || { echo "kill $pid: failed"; fail=1; }
+wait $pid 2>/dev/null
+[ $? -eq 143 ] || { echo "kill $pid: sleep not terminated"; fail=1; }
+
+[ $fail -eq 0 ] && echo "kill: ok"
+exit $fail
@@ -0,0 +1,19 @@
+#!/bin/sh
+# parallel replaces {} whether it is a whole word or part of one, and
+# appends the item when the command has no {}.
+cd "$(dirname "$0")/.." || exit 1
+fail=0
+
+check() {
+    out=$(./myshell -c "$1" 2>/dev/null)
+    [ "$out" = "$2" ] || { echo "$1: got '$out', expected '$2'"; fail=1; }
+}
+
+check 'parallel -j 1 /bin/echo {} ::: a b' "a
+b"
+check 'parallel -j 1 /bin/echo x{}y {}{} ::: a bb' "xay aa
+xbby bbbb"
+check 'parallel -j 1 /bin/echo f ::: 1' "f 1"
+
+[ $fail -eq 0 ] && echo "parallel: ok"
+exit $fail
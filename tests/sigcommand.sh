@@ -0,0 +1,26 @@
+#!/bin/sh
+# halt, ice and wakeup must reject targets that are not a pid above 0 or a
+# job: kill(0) would stop or interrupt the shell's own process group.
+cd "$(dirname "$0")/.." || exit 1
+fail=0
+
+for cmd in halt ice wakeup; do
+    for target in foo 0 %; do
+        err=$(timeout 5 ./myshell -c "$cmd $target" 2>&1 >/dev/null)
+        st=$?
+        case $err in
+        "$cmd: $target: "*) ;;
+        *) echo "$cmd $target: unexpected message: $err"; fail=1 ;;
+        esac
+        [ $st -eq 1 ] || { echo "$cmd $target: status $st, expected 1"; fail=1; }
+    done
+done
+
+out=$(printf 'sleep 3 &\nhalt %%1\njobs\nwakeup %%1\njobs\nice %%1\njobs\n' |
+    timeout 10 ./myshell 2>/dev/null)
+for state in Stopped Running Done; do
+    echo "$out" | grep -q "^\[1\].*$state" || { echo "halt/wakeup/ice %1: no $state"; fail=1; }
+done
+
+[ $fail -eq 0 ] && echo "sigcommand: ok"
+exit $fail
@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+#define TRACE_RING 4096         /* events, a power of two */
+#define SUB_BITS 5              /* 32 sub-buckets per power of two */
+#define SUB_COUNT (1 << SUB_BITS)
+#define BUCKETS (SUB_COUNT + (64 - SUB_BITS) * SUB_COUNT)
+
+typedef struct {
+    long ns;
+    long value;
+    pid_t pid;
+    int job;
+    traceType type;
+} traceRecord;
+
+typedef struct {
+    long count;
+    long min;
+    long max;
+    long buckets[BUCKETS];
+} histogram;
+
+static traceRecord ring[TRACE_RING];
+static unsigned long head;      /* events ever added */
+static unsigned long tail;      /* oldest event still in the ring */
+static char *traceFile;
+static histogram histograms[TRACE_METRICS];
+
+static const char *eventNames[TRACE_EVENT_TYPES] = {
+    "parse_start", "parse_end", "launch", "exec", "first_byte", "exit", "job_done",
+};
+static const char *metricNames[TRACE_METRICS] = {
+    "parse", "spawn", "job",
+};
+
+void traceEvent(traceType type, pid_t pid, int job, long value, long ns)
+{
+    if (head - tail == TRACE_RING && !(traceFile && traceWrite(traceFile)))
+        tail++;     /* drop the oldest */
+    traceRecord *r = &ring[head++ & (TRACE_RING - 1)];
+    r->ns = ns;
+    r->value = value;
+    r->pid = pid;
+    r->job = job;
+    r->type = type;
+}
+
+/* Values below SUB_COUNT get a bucket each; above, a power of two [2^e, */
+/* 2^(e+1)) is cut into SUB_COUNT equal buckets */
+static int bucketOf(long v)
+{
+    if (v < SUB_COUNT)
+        return v < 0 ? 0 : (int)v;
+    int e = 63 - __builtin_clzl((unsigned long)v);
+    int sub = (int)(v >> (e - SUB_BITS)) - SUB_COUNT;
+    return SUB_COUNT + (e - SUB_BITS) * SUB_COUNT + sub;
+}
+
+/* Highest value that lands in bucket i */
+static long bucketTop(int i)
+{
+    if (i < SUB_COUNT)
+        return i;
+    int e = (i - SUB_COUNT) / SUB_COUNT + SUB_BITS;
+    long sub = (i - SUB_COUNT) % SUB_COUNT;
+    return ((SUB_COUNT + sub + 1) << (e - SUB_BITS)) - 1;
+}
+
+void traceSample(traceMetric metric, long ns)
+{
+    histogram *h = &histograms[metric];
+    if (h->count == 0 || ns < h->min)
+        h->min = ns;
+    if (ns > h->max)
+        h->max = ns;
+    h->count++;
+    h->buckets[bucketOf(ns)]++;
+}
+
+/* Smallest recorded value that pct percent of the samples don't exceed, */
+/* to bucket precision */
+static long percentile(const histogram *h, double pct)
+{
+    long want = (long)(h->count * pct / 100.0 + 0.5), seen = 0;
+    if (want < 1)
+        want = 1;
+    for (int i = 0; i < BUCKETS; i++)
+        if ((seen += h->buckets[i]) >= want) {
+            long top = bucketTop(i);
+            return top > h->max ? h->max : top;
+        }
+    return h->max;
+}
+
+static void printDistribution(FILE *out, const histogram *h)
+{
+    long seen = 0;
+    fprintf(out, "  %12s %12s %10s\n", "Value(us)", "Percentile", "TotalCount");
+    for (int i = 0; i < BUCKETS; i++) {
+        if (!h->buckets[i])
+            continue;
+        seen += h->buckets[i];
+        long top = bucketTop(i);
+        fprintf(out, "  %12.3f %12.6f %10ld\n", (top > h->max ? h->max : top) / 1e3,
+                (double)seen / h->count, seen);
+    }
+}
+
+void tracePrintStats(FILE *out, bool distribution)
+{
+    static const double pcts[] = { 50, 90, 99, 99.9 };
+    fprintf(out, "%-8s %8s %10s %10s %10s %10s %10s %10s   (us)\n",
+            "metric", "count", "min", "p50", "p90", "p99", "p99.9", "max");
+    for (int m = 0; m < TRACE_METRICS; m++) {
+        const histogram *h = &histograms[m];
+        fprintf(out, "%-8s %8ld", metricNames[m], h->count);
+        if (h->count) {
+            fprintf(out, " %10.1f", h->min / 1e3);
+            for (size_t i = 0; i < sizeof(pcts) / sizeof(pcts[0]); i++)
+                fprintf(out, " %10.1f", percentile(h, pcts[i]) / 1e3);
+            fprintf(out, " %10.1f", h->max / 1e3);
+        }
+        fputc('\n', out);
+    }
+    if (distribution)
+        for (int m = 0; m < TRACE_METRICS; m++)
+            if (histograms[m].count) {
+                fprintf(out, "\n%s:\n", metricNames[m]);
+                printDistribution(out, &histograms[m]);
+            }
+    fprintf(out, "trace: %lu events in the ring, %lu recorded\n", head - tail, head);
+}
+
+bool traceWrite(const char *path)
+{
+    FILE *f = fopen(path, "ae");
+    if (!f)
+        return false;
+    for (; tail != head; tail++) {
+        const traceRecord *r = &ring[tail & (TRACE_RING - 1)];
+        fprintf(f, "{\"ns\":%ld,\"event\":\"%s\",\"pid\":%d,\"job\":%d,\"value\":%ld}\n",
+                r->ns, eventNames[r->type], (int)r->pid, r->job, r->value);
+    }
+    return fclose(f) == 0;
+}
+
+void traceSetFile(const char *path)
+{
+    free(traceFile);
+    traceFile = path ? strdup(path) : NULL;
+}
+
+void traceClose(void)
+{
+    if (traceFile && !traceWrite(traceFile))
+        perror(traceFile);
+    traceSetFile(NULL);
+}
+
+void traceReset(void)
+{
+    tail = head;
+    memset(histograms, 0, sizeof(histograms));
+}
@@ -0,0 +1,48 @@
+/* Execution trace: a fixed ring of timestamped events plus log-linear */
+/* latency histograms (HdrHistogram-style: 32 sub-buckets per power of two, */
+/* so any recorded value is known to within about 3%) */
+/* Recording is a few stores, cheap enough to stay on all the time */
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+typedef enum {
+    TRACE_PARSE_START,
+    TRACE_PARSE_END,
+    TRACE_LAUNCH,       /* about to start a child */
+    TRACE_EXEC,         /* the launch returned: value is 0, or errno if it failed */
+    TRACE_FIRST_BYTE,   /* the shell wrote a stage's first output byte (feeder, utility) */
+    TRACE_EXIT,         /* a child was reaped: value is its exit status */
+    TRACE_JOB_DONE,     /* the last process of a job was reaped: value is the duration in ns */
+    TRACE_EVENT_TYPES
+} traceType;
+
+typedef enum {
+    TRACE_PARSE_TIME,
+    TRACE_SPAWN_LATENCY,
+    TRACE_JOB_DURATION,
+    TRACE_METRICS
+} traceMetric;
+
+/* Appends an event; ns is a CLOCK_MONOTONIC time. The oldest event is */
+/* overwritten when the ring is full, unless a trace file takes it first */
+void traceEvent(traceType type, pid_t pid, int job, long value, long ns);
+
+/* Adds a sample, in nanoseconds, to a histogram */
+void traceSample(traceMetric metric, long ns);
+
+/* Prints one row per histogram: count, min, percentiles and max */
+/* With distribution, each is followed by its full percentile listing */
+void tracePrintStats(FILE *out, bool distribution);
+
+/* Appends the ring to path as JSON lines, oldest first, and empties it */
+/* Returns false if the file could not be written */
+bool traceWrite(const char *path);
+
+/* From now on, a full ring is appended to path before it wraps, and */
+/* traceClose() writes what is left. NULL stops it */
+void traceSetFile(const char *path);
+void traceClose(void);
+
+/* Empties the ring and the histograms */
+void traceReset(void);
@@ -0,0 +1,267 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "launch.h"
+#include "zygote.h"
+
+#define ZYGOTE_MSG_MAX (64 * 1024)     /* one SOCK_SEQPACKET message per request */
+#define ZYGOTE_IN  1                   /* stdin descriptor attached */
+#define ZYGOTE_OUT 2                   /* stdout descriptor attached */
+
+/* Request header, followed by path, inputRedirect, outputRedirect and the */
+/* argv strings, each NUL-terminated ("" for a missing redirect) */
+typedef struct {
+    pid_t pgid;         /* group to join, 0 for a new one */
+    int fds;            /* ZYGOTE_IN | ZYGOTE_OUT, after the cwd descriptor */
+    int argc;
+    sigset_t mask;
+    sigset_t defaults;
+} zygoteRequest;
+
+typedef struct {
+    pid_t pid;
+    int err;            /* errno of a failed launch, 0 on success */
+} zygoteReply;
+
+static int sock = -1;   /* shell's end of the socketpair */
+static pid_t helper;
+
+/* What the clone needs; it shares the helper's memory until it execs */
+typedef struct {
+    const zygoteRequest *req;
+    char **argv;
+    const char *path, *inRedirect, *outRedirect;
+    int cwd, in_fd, out_fd;
+    int err;            /* set by the clone if it could not exec */
+} zygoteChildArgs;
+
+// Runs in the clone: wire up and exec, or leave errno in a->err.
+static int zygoteChild(void *arg)
+{
+    zygoteChildArgs *a = arg;
+    setpgid(0, a->req->pgid);
+    if (fchdir(a->cwd) == -1)
+        goto fail;
+    if (a->in_fd != -1)
+        dup2(a->in_fd, STDIN_FILENO);
+    else if (*a->inRedirect) {
+        close(STDIN_FILENO);
+        if (open(a->inRedirect, O_RDONLY) == -1)
+            goto fail;
+    }
+    if (a->out_fd != -1)
+        dup2(a->out_fd, STDOUT_FILENO);
+    else if (*a->outRedirect) {
+        close(STDOUT_FILENO);
+        if (open(a->outRedirect, O_WRONLY | O_CREAT | O_TRUNC, 0644) == -1)
+            goto fail;
+    }
+    for (int sig = 1; sig < NSIG; sig++)
+        if (sigismember(&a->req->defaults, sig) == 1)
+            signal(sig, SIG_DFL);
+    sigprocmask(SIG_SETMASK, &a->req->mask, NULL);
+    execvp(a->path, a->argv);
+fail:
+    a->err = errno;
+    _exit(127);
+}
+
+// Serve one request: clone the child as the shell's, not ours, in the
+// vfork style posix_spawn uses: no page tables are copied and the helper
+// resumes once the child has exec'd or failed.
+static zygoteReply zygoteServe(char *msg, size_t len, const int *fds, int nfds)
+{
+    static char stack[64 * 1024] __attribute__((aligned(16)));
+    zygoteReply reply = { -1, EINVAL };
+    zygoteRequest req;
+    if (len < sizeof(req) || nfds < 1)
+        return reply;
+    memcpy(&req, msg, sizeof(req));
+
+    // the strings follow the header; the message ends with a NUL
+    char *s = msg + sizeof(req), *end = msg + len;
+    const char *fields[3];
+    char **argv = malloc((req.argc + 1) * sizeof(char *));
+    if (!argv) {
+        reply.err = ENOMEM;
+        return reply;
+    }
+    for (int i = 0; i < 3 + req.argc; i++) {
+        if (s >= end) {
+            free(argv);
+            return reply;
+        }
+        if (i < 3)
+            fields[i] = s;
+        else
+            argv[i - 3] = s;
+        s += strlen(s) + 1;
+    }
+    argv[req.argc] = NULL;
+
+    zygoteChildArgs a = {
+        .req = &req, .argv = argv,
+        .path = fields[0], .inRedirect = fields[1], .outRedirect = fields[2],
+        .cwd = fds[0],
+        .in_fd = (req.fds & ZYGOTE_IN) && nfds > 1 ? fds[1] : -1,
+        .out_fd = (req.fds & ZYGOTE_OUT) && nfds > 1 ? fds[nfds - 1] : -1,
+    };
+    reply.pid = clone(zygoteChild, stack + sizeof(stack),
+                      CLONE_VM | CLONE_VFORK | CLONE_PARENT | SIGCHLD, &a);
+    reply.err = reply.pid == -1 ? errno : a.err;
+    free(argv);
+    return reply;
+}
+
+static void zygoteMain(int fd)
+{
+    static char msg[ZYGOTE_MSG_MAX];
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    setpgid(0, 0);      // keep terminal signals meant for the shell's group away
+    for (;;) {
+        union {
+            struct cmsghdr hdr;
+            char buf[CMSG_SPACE(3 * sizeof(int))];
+        } control;
+        struct iovec iov = { msg, sizeof(msg) };
+        struct msghdr mh = {
+            .msg_iov = &iov, .msg_iovlen = 1,
+            .msg_control = control.buf, .msg_controllen = sizeof(control.buf),
+        };
+        ssize_t n = recvmsg(fd, &mh, MSG_CMSG_CLOEXEC);
+        if (n == 0 || (n == -1 && errno != EINTR))
+            _exit(0);   // the shell is gone
+        if (n == -1)
+            continue;
+
+        int fds[3], nfds = 0;
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c))
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+                nfds = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                if (nfds > 3)
+                    nfds = 3;
+                memcpy(fds, CMSG_DATA(c), nfds * sizeof(int));
+            }
+        zygoteReply reply = zygoteServe(msg, n, fds, nfds);
+        for (int i = 0; i < nfds; i++)
+            close(fds[i]);
+        send(fd, &reply, sizeof(reply), 0);
+    }
+}
+
+bool zygoteStart(void)
+{
+    int sv[2];
+    if (sock != -1)
+        return true;
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1)
+        return false;
+    pid_t pid = fork();
+    if (pid == -1) {
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        zygoteMain(sv[1]);
+    }
+    close(sv[1]);
+    sock = sv[0];
+    helper = pid;
+    return true;
+}
+
+bool zygoteRunning(void)
+{
+    return sock != -1;
+}
+
+pid_t zygoteLaunch(const launchSpec *spec, const sigset_t *mask, const sigset_t *defaults)
+{
+    static char msg[ZYGOTE_MSG_MAX];
+    zygoteRequest req = {
+        .pgid = spec->pgid == LAUNCH_NEW_PGROUP ? 0 : spec->pgid ? spec->pgid : getpgrp(),
+        .fds = (spec->in_fd != -1 ? ZYGOTE_IN : 0) | (spec->out_fd != -1 ? ZYGOTE_OUT : 0),
+        .mask = *mask,
+        .defaults = *defaults,
+    };
+    while (spec->argv[req.argc])
+        req.argc++;
+
+    // header, then every string with its NUL
+    size_t len = sizeof(req);
+    const char *fields[3] = {
+        spec->path,
+        spec->inputRedirect ? spec->inputRedirect : "",
+        spec->outputRedirect ? spec->outputRedirect : "",
+    };
+    for (int i = 0; i < 3 + req.argc; i++) {
+        const char *s = i < 3 ? fields[i] : spec->argv[i - 3];
+        size_t n = strlen(s) + 1;
+        if (len + n > sizeof(msg)) {
+            errno = E2BIG;
+            return -1;
+        }
+        memcpy(msg + len, s, n);
+        len += n;
+    }
+    memcpy(msg, &req, sizeof(req));
+
+    int fds[3], nfds = 0;
+    if ((fds[nfds++] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return -1;
+    if (spec->in_fd != -1)
+        fds[nfds++] = spec->in_fd;
+    if (spec->out_fd != -1)
+        fds[nfds++] = spec->out_fd;
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = { msg, len };
+    struct msghdr mh = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = control.buf, .msg_controllen = CMSG_SPACE(nfds * sizeof(int)),
+    };
+    struct cmsghdr *c = CMSG_FIRSTHDR(&mh);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+    memcpy(CMSG_DATA(c), fds, nfds * sizeof(int));
+
+    zygoteReply reply;
+    ssize_t sent = sendmsg(sock, &mh, 0);
+    close(fds[0]);
+    if (sent == -1 || recv(sock, &reply, sizeof(reply), 0) != sizeof(reply)) {
+        zygoteStop();   // helper died: callers fall back
+        return -1;
+    }
+    if (reply.err) {
+        // the failed child is ours to reap, like posix_spawn does
+        if (reply.pid > 0)
+            waitpid(reply.pid, NULL, 0);
+        errno = reply.err;
+        return -1;
+    }
+    return reply.pid;
+}
+
+void zygoteStop(void)
+{
+    if (sock == -1)
+        return;
+    close(sock);
+    sock = -1;
+    waitpid(helper, NULL, 0);
+}
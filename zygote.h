@@ -0,0 +1,28 @@
+/* Launch helper ("zygote") forked at startup, while the shell is still small */
+/* The shell sends it launch requests over a socketpair, with the child's */
+/* stdin/stdout and the shell's cwd passed as SCM_RIGHTS descriptors */
+/* It clones every child with CLONE_PARENT, so children are the shell's own: */
+/* they signal SIGCHLD to the shell and are reaped by its wait4 as usual */
+/* Launch cost then follows the helper's size, not the shell's heap */
+#include <stdbool.h>
+#include <signal.h>
+#include <sys/types.h>
+
+struct launchSpec;   /* launch.h */
+
+/* Forks the helper. Returns false if it could not be started */
+bool zygoteStart(void);
+
+/* True while the helper is connected */
+bool zygoteRunning(void);
+
+/* Starts spec->path through the helper with the given signal mask and */
+/* signals reset to default. The helper uses its own environment, the */
+/* one the shell had at startup. spec->sched is not supported */
+/* Returns the child's pid, or -1 with errno set. If the helper is gone */
+/* or the request does not fit in one message, zygoteRunning() is false */
+/* or errno is E2BIG and the caller should launch another way */
+pid_t zygoteLaunch(const struct launchSpec *spec, const sigset_t *mask, const sigset_t *defaults);
+
+/* Disconnects; the helper exits */
+void zygoteStop(void);